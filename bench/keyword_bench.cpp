@@ -0,0 +1,114 @@
+#define LEXPP_IMPLEMENTATION
+#include "../lexpp.h"
+#include "../extensions/syntax_parser.h"
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <fstream>
+#include <chrono>
+#include <random>
+#include <map>
+
+// Compares the keyword lookup of SyntaxParser (KeywordSet) with a linear std::find over the keyword list
+// on the identifiers and keywords of source files, the language is picked from the file extension
+// Usage : keyword_bench [source files ...] (a corpus is generated for every language without files)
+
+static const std::map<std::string, lexpp::SyntaxParserLanguage> extensions = {
+    {".c", lexpp::C}, {".h", lexpp::C}, {".cpp", lexpp::CPlusPlus}, {".hpp", lexpp::CPlusPlus}, {".cc", lexpp::CPlusPlus},
+    {".java", lexpp::Java}, {".py", lexpp::Python}, {".cs", lexpp::CSharp}, {".rs", lexpp::Rust}, {".go", lexpp::Go},
+    {".glsl", lexpp::GLSL}, {".hlsl", lexpp::HLSL}, {".js", lexpp::JavaScript}, {".lua", lexpp::Lua},
+    {".coffee", lexpp::CoffeeScript}, {".ts", lexpp::TypeScript}, {".swift", lexpp::Swift}, {".kt", lexpp::Kotlin},
+    {".m", lexpp::ObjectiveC}, {".mm", lexpp::ObjectiveCPlusPlus}, {".as", lexpp::ActionScript}, {".scala", lexpp::Scala}
+};
+
+static std::string read_file(const std::string& path)
+{
+    std::ifstream t(path);
+    return std::string((std::istreambuf_iterator<char>(t)), std::istreambuf_iterator<char>());
+}
+
+// Identifier like words where about a third are keywords of language
+static std::string generate_source(lexpp::SyntaxParserLanguage language, size_t size)
+{
+    static const char* words[] = {"value", "i", "count", "buffer", "foo", "bar", "index", "result", "data", "x"};
+    std::vector<std::string> keywords = lexpp::SyntaxParser("", language).get_keywords();
+    std::mt19937 rng(42);
+    std::string data;
+    while(data.size() < size){
+        if(!keywords.empty() && rng() % 3 == 0)
+            data += keywords[rng() % keywords.size()];
+        else
+            data += words[rng() % 10];
+        data += (rng() % 8 == 0) ? "\n" : " ";
+    }
+    return data;
+}
+
+template<typename Function>
+static double best_of(int runs, Function function)
+{
+    double best = 1e30;
+    for(int i = 0 ; i < runs ; i++){
+        auto begin = std::chrono::steady_clock::now();
+        function();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+    }
+    return best;
+}
+
+static void bench(const std::string& name, const std::string& data, lexpp::SyntaxParserLanguage language)
+{
+    lexpp::SyntaxParser parser(data, language);
+    lexpp::lex(parser);
+    std::vector<std::string> words;
+    for(const lexpp::SyntaxToken& token : parser.get_tokens())
+        if(token.type == lexpp::Keyword || token.type == lexpp::Identifier)
+            words.push_back(token.value);
+    if(words.empty())
+        return;
+
+    std::vector<std::string> keywords = parser.get_keywords();
+    lexpp::KeywordSet keywordSet(keywords);
+    size_t linearHits = 0, setHits = 0;
+    double linear = best_of(5, [&]{
+        linearHits = 0;
+        for(const std::string& word : words)
+            linearHits += std::find(keywords.begin(), keywords.end(), word) != keywords.end();
+    });
+    double hashed = best_of(5, [&]{
+        setHits = 0;
+        for(const std::string& word : words)
+            setHits += keywordSet.contains(word);
+    });
+    double lexing = best_of(3, [&]{ lexpp::SyntaxParser p(data, language); lexpp::lex(p); });
+
+    std::cout << name << " (" << lexpp::to_string(language) << ", " << keywords.size() << " keywords, " << words.size() << " words)" << std::endl;
+    std::cout << "    std::find  : " << (linear / words.size() * 1e9) << " ns/word" << std::endl;
+    std::cout << "    KeywordSet : " << (hashed / words.size() * 1e9) << " ns/word" << std::endl;
+    std::cout << "    SyntaxParser : " << (data.size() / lexing / 1e6) << " MB/s" << std::endl;
+    if(linearHits != setHits)
+        std::cout << "    KeywordSet and std::find disagree!" << std::endl;
+}
+
+int main(int argc, char** argv){
+
+    if(argc > 1){
+        for(int i = 1 ; i < argc ; i++){
+            std::string path = argv[i];
+            size_t dot = path.rfind('.');
+            auto it = extensions.find(dot == std::string::npos ? "" : path.substr(dot));
+            if(it == extensions.end()){
+                std::cout << "Skipping " << path << " (unknown extension)" << std::endl;
+                continue;
+            }
+            bench(path, read_file(path), it->second);
+        }
+    }
+    else{
+        for(int language = lexpp::C ; language <= lexpp::Scala ; language++)
+            bench("generated", generate_source((lexpp::SyntaxParserLanguage)language, 4 << 20), (lexpp::SyntaxParserLanguage)language);
+    }
+
+    return 0;
+}
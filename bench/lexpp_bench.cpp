@@ -0,0 +1,401 @@
+#define LEXPP_IMPLEMENTATION
+#include "../lexpp.h"
+#include "../extensions/syntax_parser.h"
+#include "../extensions/xml_parser.h"
+#include "../extensions/parallel.h"
+#include "../extensions/rule_lexer.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <new>
+#include <map>
+#include <algorithm>
+
+// Runs every lexing path over generated corpora and reports MB/s, tokens/s, allocations per token and peak heap use
+// Build : g++ -std=c++17 -O2 -pthread bench/lexpp_bench.cpp -o lexpp_bench
+// Usage : lexpp_bench [--size MB] [--density 0..1] [--filter text] [--json out.json] [--baseline base.json] [--tolerance 0.1]
+// With --baseline the exit code is 1 if any benchmark got slower than the baseline by more than tolerance,
+// so a baseline saved with --json on the same machine turns this into a regression check
+
+// Every allocation of the process goes through these, the counters are read around a single run
+static std::atomic<size_t> allocationCount(0);
+// Bytes allocated and not freed yet and the most there were since peakBytes was last reset
+static std::atomic<size_t> liveBytes(0);
+static std::atomic<size_t> peakBytes(0);
+
+// The size is kept in front of the block so a free knows how many bytes it gives back.
+// The block starts alignment bytes before the pointer, at least 16 to keep the alignment malloc gives
+static void* bench_allocate(size_t size, size_t alignment = 16)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    alignment = std::max<size_t>(alignment, 16);
+    size_t total = (alignment + size + alignment - 1) / alignment * alignment;
+#ifdef _WIN32
+    char* block = (char*)_aligned_malloc(total, alignment);
+#else
+    char* block = (char*)std::aligned_alloc(alignment, total);
+#endif
+    if(!block)
+        throw std::bad_alloc();
+    char* pointer = block + alignment;
+    *(size_t*)(pointer - sizeof(size_t)) = size;
+    size_t live = liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    size_t peak = peakBytes.load(std::memory_order_relaxed);
+    while(live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed));
+    return pointer;
+}
+
+static void bench_free(void* pointer, size_t alignment = 16)
+{
+    if(!pointer)
+        return;
+    alignment = std::max<size_t>(alignment, 16);
+    liveBytes.fetch_sub(*(size_t*)((char*)pointer - sizeof(size_t)), std::memory_order_relaxed);
+#ifdef _WIN32
+    _aligned_free((char*)pointer - alignment);
+#else
+    std::free((char*)pointer - alignment);
+#endif
+}
+
+void* operator new(size_t size) { return bench_allocate(size); }
+void* operator new[](size_t size) { return bench_allocate(size); }
+void operator delete(void* pointer) noexcept { bench_free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { bench_free(pointer); }
+void operator delete[](void* pointer) noexcept { bench_free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { bench_free(pointer); }
+// std::pmr::new_delete_resource allocates through the aligned forms
+void* operator new(size_t size, std::align_val_t alignment) { return bench_allocate(size, (size_t)alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return bench_allocate(size, (size_t)alignment); }
+void operator delete(void* pointer, std::align_val_t alignment) noexcept { bench_free(pointer, (size_t)alignment); }
+void operator delete(void* pointer, size_t, std::align_val_t alignment) noexcept { bench_free(pointer, (size_t)alignment); }
+void operator delete[](void* pointer, std::align_val_t alignment) noexcept { bench_free(pointer, (size_t)alignment); }
+void operator delete[](void* pointer, size_t, std::align_val_t alignment) noexcept { bench_free(pointer, (size_t)alignment); }
+
+struct BenchResult
+{
+    std::string name;
+    double mbPerSecond = 0;
+    double tokensPerSecond = 0;
+    double allocationsPerToken = 0;
+    // Most heap a single run had allocated on top of what was allocated before it
+    size_t peakHeapKb = 0;
+};
+
+struct BenchOptions
+{
+    size_t size = 16 << 20;
+    double density = 0.2;
+    std::string filter = "";
+    std::string jsonPath = "";
+    std::string baselinePath = "";
+    double tolerance = 0.1;
+};
+
+static const char* separators = "\n :,[]{}().\t";
+
+// Words of 1 to 15 letters with about density of the bytes being separators
+static std::string generate_text(size_t size, double density)
+{
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    std::string data;
+    data.reserve(size + 16);
+    while(data.size() < size){
+        if(chance(rng) < density)
+            data += separators[rng() % 12];
+        else
+            data += (char)('a' + rng() % 26);
+    }
+    return data;
+}
+
+// Code like text using the keywords of language
+static std::string generate_code(size_t size, lexpp::SyntaxParserLanguage language)
+{
+    static const char* words[] = {"x", "=", "42", ";", "(", "i", "<", "10", ")", "{", "}", "\"some text\"", "'c'", "foo", ".", "bar", "+", "\n", "->", "3.14f", "::", "&&", ","};
+    std::vector<std::string> keywords = lexpp::SyntaxParser("", language).get_keywords();
+    std::mt19937 rng(42);
+    std::string data;
+    data.reserve(size + 32);
+    while(data.size() < size){
+        if(!keywords.empty() && rng() % 4 == 0)
+            data += keywords[rng() % keywords.size()];
+        else
+            data += words[rng() % 23];
+        data += ' ';
+    }
+    return data;
+}
+
+static std::string generate_xml(size_t size)
+{
+    std::mt19937 rng(42);
+    std::string data = "<CATALOG>\n";
+    while(data.size() < size){
+        data += "  <PLANT zone=\"" + std::to_string(rng() % 10) + "\">\n";
+        data += "    <COMMON>Bloodroot " + std::to_string(rng()) + "</COMMON>\n";
+        data += "  </PLANT>\n";
+    }
+    data += "</CATALOG>\n";
+    return data;
+}
+
+class CountingParser : public lexpp::TokenParser
+{
+    public:
+    CountingParser(std::string data)
+    :TokenParser(data, separators, true){}
+
+    virtual int process_token(std::string& token, bool* discard, bool isSeparator, lexpp::Token*) override
+    {
+        *discard = isSeparator;
+        return (token.size() > 0 && token[0] >= '0' && token[0] <= '9') ? 1 : 0;
+    }
+};
+
+// XMLParser discards every token, this counts the ones it was given
+class CountingXMLParser : public lexpp::XMLParser
+{
+    public:
+    CountingXMLParser(std::string data)
+    :XMLParser(data){}
+
+    virtual int process_token(std::string& token, bool* discard, bool isSeparator, lexpp::Token* tok) override
+    {
+        count++;
+        return XMLParser::process_token(token, discard, isSeparator, tok);
+    }
+
+    size_t count = 0;
+};
+
+// Runs function (returning the number of tokens) a few times and keeps the fastest run
+template<typename Function>
+static void run(std::vector<BenchResult>& results, const BenchOptions& options, const char* name, size_t bytes, Function function)
+{
+    if(options.filter.size() > 0 && std::string(name).find(options.filter) == std::string::npos)
+        return;
+    BenchResult result;
+    result.name = name;
+    double best = 1e30;
+    size_t tokens = 0, allocations = 0, peak = 0;
+    for(int i = 0 ; i < 3 ; i++){
+        size_t allocationsBefore = allocationCount.load();
+        size_t liveBefore = liveBytes.load();
+        peakBytes.store(liveBefore);
+        auto begin = std::chrono::steady_clock::now();
+        tokens = function();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        allocations = allocationCount.load() - allocationsBefore;
+        peak = std::max(peak, peakBytes.load() - liveBefore);
+        best = std::min(best, seconds);
+    }
+    result.mbPerSecond = bytes / best / 1e6;
+    result.tokensPerSecond = tokens / best;
+    result.allocationsPerToken = tokens > 0 ? (double)allocations / tokens : 0;
+    result.peakHeapKb = peak / 1024;
+    std::cout << name << " : " << result.mbPerSecond << " MB/s, " << (result.tokensPerSecond / 1e6) << " M tokens/s, "
+              << result.allocationsPerToken << " allocations/token, " << result.peakHeapKb << " KB peak heap" << std::endl;
+    results.push_back(result);
+}
+
+// One benchmark per line so the baseline can be read back without a JSON library
+static void write_json(const std::string& path, const BenchOptions& options, const std::vector<BenchResult>& results)
+{
+    std::ofstream out(path);
+    out << "{\n  \"size\": " << options.size << ",\n  \"density\": " << options.density << ",\n  \"results\": [\n";
+    for(size_t i = 0 ; i < results.size() ; i++){
+        const BenchResult& result = results[i];
+        out << "    {\"name\": \"" << result.name << "\", \"mb_per_s\": " << result.mbPerSecond << ", \"tokens_per_s\": " << result.tokensPerSecond
+            << ", \"allocations_per_token\": " << result.allocationsPerToken << ", \"peak_heap_kb\": " << result.peakHeapKb << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+static double read_number(const std::string& line, const std::string& key)
+{
+    size_t position = line.find("\"" + key + "\": ");
+    if(position == std::string::npos)
+        return 0;
+    return std::atof(line.c_str() + position + key.size() + 4);
+}
+
+// Name to MB/s of every result in a file written by write_json
+static std::map<std::string, double> read_baseline(const std::string& path)
+{
+    std::map<std::string, double> baseline;
+    std::ifstream in(path);
+    std::string line;
+    while(std::getline(in, line)){
+        size_t begin = line.find("{\"name\": \"");
+        if(begin == std::string::npos)
+            continue;
+        begin += 10;
+        size_t end = line.find('"', begin);
+        baseline[line.substr(begin, end - begin)] = read_number(line, "mb_per_s");
+    }
+    return baseline;
+}
+
+// Returns the number of benchmarks slower than the baseline by more than the tolerance
+static int compare_baseline(const BenchOptions& options, const std::vector<BenchResult>& results)
+{
+    std::map<std::string, double> baseline = read_baseline(options.baselinePath);
+    if(baseline.empty()){
+        std::cout << "Could not read a baseline from " << options.baselinePath << std::endl;
+        return 1;
+    }
+    int regressions = 0;
+    for(const BenchResult& result : results){
+        auto it = baseline.find(result.name);
+        if(it == baseline.end() || it->second <= 0)
+            continue;
+        double change = result.mbPerSecond / it->second - 1.0;
+        if(change < -options.tolerance){
+            std::cout << "REGRESSION " << result.name << " : " << it->second << " -> " << result.mbPerSecond << " MB/s (" << (change * 100) << "%)" << std::endl;
+            regressions++;
+        }
+    }
+    std::cout << regressions << " regression(s) against " << options.baselinePath << std::endl;
+    return regressions;
+}
+
+int main(int argc, char** argv){
+
+    BenchOptions options;
+    for(int i = 1 ; i < argc ; i += 2){
+        std::string option = argv[i];
+        if(i + 1 == argc){
+            std::cout << "Option " << option << " needs a value" << std::endl;
+            return -1;
+        }
+        if(option == "--size")
+            options.size = (size_t)(std::atof(argv[i + 1]) * (1 << 20));
+        else if(option == "--density")
+            options.density = std::atof(argv[i + 1]);
+        else if(option == "--filter")
+            options.filter = argv[i + 1];
+        else if(option == "--json")
+            options.jsonPath = argv[i + 1];
+        else if(option == "--baseline")
+            options.baselinePath = argv[i + 1];
+        else if(option == "--tolerance")
+            options.tolerance = std::atof(argv[i + 1]);
+        else{
+            std::cout << "Unknown option " << option << std::endl;
+            return -1;
+        }
+    }
+
+    std::vector<BenchResult> results;
+    std::string text = generate_text(options.size, options.density);
+    std::vector<std::string> separatorList = {"\n", " ", ":", ",", "[", "]", "{", "}", "(", ")", ".", "\t"};
+    lexpp::Lexer lexer(separators);
+    typedef lexpp::StaticLexer<'\n', ' ', ':', ',', '[', ']', '{', '}', '(', ')', '.', '\t'> CodeLexer;
+
+    run(results, options, "lex(string separators)", text.size(), [&]{ return lexpp::lex(text, separators).size(); });
+    run(results, options, "lex(vector separators)", text.size(), [&]{ return lexpp::lex(text, separatorList).size(); });
+    run(results, options, "lex(tokenFunction)", text.size(), [&]{
+        return lexpp::lex(text, separatorList, std::function<int(std::string&, bool*, bool)>([](std::string&, bool*, bool){ return 0; })).size();
+    });
+    run(results, options, "lex(tokenFunction, Token*)", text.size(), [&]{
+        return lexpp::lex(text, separatorList, std::function<int(std::string&, bool*, bool, lexpp::Token*)>([](std::string&, bool*, bool, lexpp::Token*){ return 0; })).size();
+    });
+    run(results, options, "lex(shared_ptr<TokenParser>)", text.size(), [&]{ return lexpp::lex(std::make_shared<CountingParser>(text)).size(); });
+    run(results, options, "lex(Parser&)", text.size(), [&]{ CountingParser parser(text); return lexpp::lex(parser).size(); });
+    run(results, options, "lex(pmr)", text.size(), [&]{
+        std::pmr::monotonic_buffer_resource resource;
+        return lexpp::lex(text, separators, false, &resource).size();
+    });
+    run(results, options, "lex_view(string separators)", text.size(), [&]{ return lexpp::lex_view(text, separators).size(); });
+    run(results, options, "lex_view(vector separators)", text.size(), [&]{ return lexpp::lex_view(text, separatorList).size(); });
+    run(results, options, "lex_view(tokenFunction)", text.size(), [&]{
+        return lexpp::lex_view(text, separatorList, std::function<int(std::string_view, bool*, bool, lexpp::TokenView*)>([](std::string_view, bool*, bool, lexpp::TokenView*){ return 0; })).size();
+    });
+    run(results, options, "lex_view(pmr)", text.size(), [&]{
+        std::pmr::monotonic_buffer_resource resource;
+        return lexpp::lex_view(text, separators, false, &resource).size();
+    });
+    run(results, options, "lex_buffer", text.size(), [&]{ return lexpp::lex_buffer(text, separators).size(); });
+    run(results, options, "TokenRange", text.size(), [&]{
+        size_t count = 0;
+        lexpp::TokenRange range(text, separators);
+        for(auto it = range.begin() ; it != range.end() ; ++it)
+            count++;
+        return count;
+    });
+    run(results, options, "StaticLexer::lex_view", text.size(), [&]{ return CodeLexer::lex_view(text).size(); });
+    run(results, options, "Lexer::lex_view", text.size(), [&]{ return lexer.lex_view(text).size(); });
+    run(results, options, "StreamLexer", text.size(), [&]{
+        size_t count = 0;
+        lexpp::StreamLexer stream(separators, [&count](std::string_view, bool, size_t){ count++; });
+        for(size_t i = 0 ; i < text.size() ; i += 1 << 16)
+            stream.feed(std::string_view(text).substr(i, 1 << 16));
+        stream.finish();
+        return count;
+    });
+    run(results, options, "lex_parallel", text.size(), [&]{ return lexpp::lex_parallel(text, separators).size(); });
+
+    struct Language { lexpp::SyntaxParserLanguage language; const char* virtualName; const char* templateName; };
+    static const Language languages[] = {
+        {lexpp::C, "SyntaxParser C virtual", "SyntaxParser C template"},
+        {lexpp::CPlusPlus, "SyntaxParser C++ virtual", "SyntaxParser C++ template"},
+        {lexpp::Python, "SyntaxParser Python virtual", "SyntaxParser Python template"},
+        {lexpp::Rust, "SyntaxParser Rust virtual", "SyntaxParser Rust template"},
+        {lexpp::JavaScript, "SyntaxParser JavaScript virtual", "SyntaxParser JavaScript template"}
+    };
+    for(const Language& language : languages){
+        std::string code = generate_code(options.size, language.language);
+        run(results, options, language.virtualName, code.size(), [&]{
+            auto parser = std::make_shared<lexpp::SyntaxParser>(code, language.language);
+            lexpp::lex(parser);
+            return parser->get_tokens().size();
+        });
+        run(results, options, language.templateName, code.size(), [&]{
+            lexpp::SyntaxParser parser(code, language.language);
+            lexpp::lex(parser);
+            return parser.get_tokens().size();
+        });
+    }
+
+    std::string code = generate_code(options.size, lexpp::CPlusPlus);
+    run(results, options, "SyntaxParser C++ scan", code.size(), [&]{
+        lexpp::SyntaxParser parser(code, lexpp::CPlusPlus);
+        parser.scan();
+        return parser.get_tokens().size();
+    });
+    lexpp::RuleLexer ruleLexer({
+        {"int|for|if|return|void", 0},
+        {"[a-zA-Z_]\\w*", 1},
+        {"\\d+(\\.\\d+)?f?", 2},
+        {"\"([^\"\\\\\\n]|\\\\.)*\"|'([^'\\\\\\n]|\\\\.)*'", 3},
+        {"\\s+", 4, true},
+        {"::|->|&&|[-+*/=<>!&|.,;:(){}\\[\\]]", 5}
+    });
+    run(results, options, "RuleLexer", code.size(), [&]{
+        size_t count = 0;
+        ruleLexer.for_each(code, [&count](std::string_view, int, size_t){ count++; });
+        return count;
+    });
+
+    std::string xml = generate_xml(options.size);
+    run(results, options, "XMLParser", xml.size(), [&]{
+        CountingXMLParser parser(xml);
+        lexpp::lex(parser);
+        return parser.count;
+    });
+
+    if(options.jsonPath.size() > 0)
+        write_json(options.jsonPath, options, results);
+    if(options.baselinePath.size() > 0 && compare_baseline(options, results) > 0)
+        return 1;
+
+    return 0;
+}
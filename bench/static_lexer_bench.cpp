@@ -0,0 +1,75 @@
+#define LEXPP_IMPLEMENTATION
+#include "../lexpp.h"
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <fstream>
+#include <chrono>
+#include <random>
+
+// Compares StaticLexer against the runtime lex / lex_view with the separators of examples/advanced_custom_lexer.cpp
+// Usage : static_lexer_bench [filename] (a random corpus is generated without a file)
+
+typedef lexpp::StaticLexer<'\n', ' ', ':', ',', '[', ']', '{', '}', '(', ')', '.', '\t'> CodeLexer;
+static const char* separators = "\n :,[]{}().\t";
+
+static std::string generate_corpus(size_t size)
+{
+    std::mt19937 rng(42);
+    std::string data;
+    data.reserve(size);
+    while(data.size() < size){
+        size_t length = 1 + rng() % 10;
+        for(size_t i = 0 ; i < length ; i++)
+            data += (char)('a' + rng() % 26);
+        data += separators[rng() % 12];
+    }
+    return data;
+}
+
+template<typename Function>
+static void run(const char* name, const std::string& data, int iterations, Function function)
+{
+    size_t tokens = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for(int i = 0 ; i < iterations ; i++)
+        tokens += function();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    std::cout << name << " : " << (data.size() * (double)iterations / seconds / 1e6) << " MB/s, " << (tokens / seconds / 1e6) << " M tokens/s" << std::endl;
+}
+
+int main(int argc, char** argv){
+
+    std::string data;
+    if(argc > 1){
+        std::ifstream t(argv[1]);
+        t.seekg(0, std::ios::end);
+        size_t size = t.tellg();
+        data = std::string(size, ' ');
+        t.seekg(0);
+        t.read(&data[0], size);
+    }
+    else{
+        data = generate_corpus(64 << 20);
+    }
+
+    // Make sure both produce the same tokens before timing them
+    if(CodeLexer::lex(data, true) != lexpp::lex(data, separators, true)){
+        std::cout << "StaticLexer and lex disagree!" << std::endl;
+        return -1;
+    }
+
+    const int iterations = 5;
+    run("lex                  ", data, iterations, [&]{ return lexpp::lex(data, separators).size(); });
+    run("StaticLexer::lex     ", data, iterations, [&]{ return CodeLexer::lex(data).size(); });
+    run("lex_view             ", data, iterations, [&]{ return lexpp::lex_view(data, separators).size(); });
+    run("StaticLexer::lex_view", data, iterations, [&]{ return CodeLexer::lex_view(data).size(); });
+    run("StaticLexer::for_each", data, iterations, [&]{
+        size_t count = 0;
+        CodeLexer::for_each(data, false, [&count](std::string_view, bool){ count++; });
+        return count;
+    });
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+#define LEXPP_IMPLEMENTATION
+#include "../lexpp.h"
+#include "../extensions/syntax_parser.h"
+#include "../extensions/xml_parser.h"
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+
+// Compares lex(std::shared_ptr<TokenParser>) (virtual calls) with lex(Parser&) (direct calls)
+// Usage : token_parser_bench [size in MB]
+
+enum MyTokens{
+    Keyword = 0,
+    Number,
+    String,
+    Other
+};
+
+class MyTokenParser : public lexpp::TokenParser
+{
+    public:
+    MyTokenParser(std::string data, std::string separators)
+    :TokenParser(data, separators, true){}
+
+    virtual int process_token(std::string& token, bool* discard, bool isSeparator, lexpp::Token* tok) override
+    {
+        if(isSeparator){
+            *discard = true;
+            return MyTokens::Other;
+        }
+        if(token.size() > 0 && token[0] >= '0' && token[0] <= '9')
+            return MyTokens::Number;
+        if(token == "for" || token == "if" || token == "int")
+            return MyTokens::Keyword;
+        return MyTokens::String;
+    }
+};
+
+static std::string generate_code(size_t size)
+{
+    static const char* words[] = {"int", "x", "=", "42", ";", "for", "(", "i", "<", "10", ")", "{", "}", "\"text\"", "foo", ".", "bar", "+", "\n", "if"};
+    std::mt19937 rng(42);
+    std::string data;
+    data.reserve(size);
+    while(data.size() < size){
+        data += words[rng() % 20];
+        data += ' ';
+    }
+    return data;
+}
+
+static std::string generate_xml(size_t size)
+{
+    std::mt19937 rng(42);
+    std::string data = "<CATALOG>\n";
+    while(data.size() < size){
+        data += "  <PLANT zone=\"" + std::to_string(rng() % 10) + "\">\n";
+        data += "    <COMMON>Bloodroot " + std::to_string(rng()) + "</COMMON>\n";
+        data += "  </PLANT>\n";
+    }
+    data += "</CATALOG>\n";
+    return data;
+}
+
+// Reports the best of a few runs
+template<typename Function>
+static void run(const char* name, size_t bytes, Function function)
+{
+    double best = 1e30;
+    for(int i = 0 ; i < 3 ; i++){
+        auto begin = std::chrono::steady_clock::now();
+        function();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count());
+    }
+    std::cout << name << " : " << (bytes / best / 1e6) << " MB/s" << std::endl;
+}
+
+int main(int argc, char** argv){
+
+    size_t size = (argc > 1 ? std::atoi(argv[1]) : 16) << 20;
+    std::string code = generate_code(size);
+    std::string xml = generate_xml(size);
+
+    run("MyTokenParser virtual ", code.size(), [&]{ lexpp::lex(std::make_shared<MyTokenParser>(code, "\n :,[]{}().\t")); });
+    run("MyTokenParser template", code.size(), [&]{ MyTokenParser parser(code, "\n :,[]{}().\t"); lexpp::lex(parser); });
+
+    run("SyntaxParser virtual  ", code.size(), [&]{ lexpp::lex(std::make_shared<lexpp::SyntaxParser>(code, lexpp::CPlusPlus)); });
+    run("SyntaxParser template ", code.size(), [&]{ lexpp::SyntaxParser parser(code, lexpp::CPlusPlus); lexpp::lex(parser); });
+
+    run("XMLParser virtual     ", xml.size(), [&]{ lexpp::lex(std::make_shared<lexpp::XMLParser>(xml)); });
+    run("XMLParser template    ", xml.size(), [&]{ lexpp::XMLParser parser(xml); lexpp::lex(parser); });
+
+    return 0;
+}
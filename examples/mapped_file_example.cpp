@@ -0,0 +1,28 @@
+#define LEXPP_IMPLEMENTATION
+#include "lexpp.h"
+#include "extensions/mapped_file.h"
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+int main(int argc, char** argv){
+
+    if(argc <= 1){
+        std::cout << "Usage : lexpp filename" << std::endl;
+        exit(-1);
+    }
+
+    // The file is mapped instead of read into a string, the tokens point into the mapping
+    lexpp::MappedTokens<std::string_view> result = lexpp::lex_file(argv[1], {"<=", "<<", "\n", "::", ",", "}", "{", ";", " "}, false);
+    if(!result.file.is_open()){
+        std::cout << "Could not open " << argv[1] << std::endl;
+        exit(-1);
+    }
+
+    for(std::string_view token : result.tokens){
+        std::cout << token << std::endl;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,59 @@
+#define LEXPP_IMPLEMENTATION
+#include "../lexpp.h"
+#include "../extensions/rule_lexer.h"
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <fstream>
+
+// Same token types as advanced_custom_lexer.cpp but found by rules in one pass instead of
+// splitting first and classifying in process_token
+enum MyTokens{
+    Keyword = 0,
+    Number,
+    String,
+    Other
+};
+
+static std::string TokenToString(int tok){
+    switch(tok){
+        case Keyword: return "Keyword";
+        case Number:  return "Number";
+        case String:  return "String";
+        case Other:   return "Other";
+    }
+    return "Unmatched";
+}
+
+int main(int argc, char** argv){
+
+    if(argc <= 1){
+        std::cout << "Usage : rule_lexer_example filename" << std::endl;
+        exit(-1);
+    }
+    std::ifstream t(argv[1]);
+    std::string data((std::istreambuf_iterator<char>(t)), std::istreambuf_iterator<char>());
+
+    // Keywords come before identifiers so they win when both match the same text
+    lexpp::RuleLexer lexer({
+        {"for|void|return|if|int", MyTokens::Keyword},
+        {"[a-zA-Z_]\\w*", MyTokens::String},
+        {"\\d+", MyTokens::Number},
+        {"\"([^\"\\\\\\n]|\\\\.)*\"", MyTokens::String},
+        {"//[^\\n]*", MyTokens::Other, true},
+        {"\\s+", MyTokens::Other, true},
+        {"[:,\\[\\]{}().;]", MyTokens::Other},
+        {lexpp::escape_pattern("<<") + "|" + lexpp::escape_pattern("<=") + "|[-+*/=<>!&|]", MyTokens::Other}
+    });
+    if(!lexer.is_valid()){
+        std::cout << lexer.error() << std::endl;
+        return -1;
+    }
+
+    for(lexpp::TokenView& token : lexer.lex_view(data)){
+        std::cout << "Token : " << token.value << " [" << TokenToString(token.type) << "]" << std::endl;
+    }
+
+    return 0;
+}
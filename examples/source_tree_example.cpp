@@ -0,0 +1,27 @@
+#define LEXPP_IMPLEMENTATION
+#include "lexpp.h"
+#include "extensions/source_tree.h"
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+int main(int argc, char** argv){
+
+    if(argc <= 1){
+        std::cout << "Usage : lexpp directory" << std::endl;
+        exit(-1);
+    }
+
+    // The sink is called from many threads at once
+    std::mutex outputMutex;
+    size_t totalTokens = 0;
+    size_t fileCount = lexpp::lex_tree(argv[1], lexpp::default_language_map(), [&](lexpp::SourceFile& file){
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::cout << file.path << " [" << lexpp::to_string(file.language) << "] : " << file.tokens.size() << " tokens" << std::endl;
+        totalTokens += file.tokens.size();
+    });
+
+    std::cout << fileCount << " files, " << totalTokens << " tokens" << std::endl;
+    return 0;
+}
@@ -0,0 +1,29 @@
+#define LEXPP_IMPLEMENTATION
+#include "../lexpp.h"
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+
+// Lexes stdin in small chunks so the input can be a pipe of any size
+// Usage : cat file | stream_lexer_example
+
+int main(int argc, char** argv){
+
+    size_t tokenCount = 0;
+    lexpp::StreamLexer lexer({"<=", "<<", "\n", "::", ",", "}", "{", ";", " "}, [&tokenCount](std::string_view token, bool isSeparator, size_t location){
+        std::cout << location << " : " << token << std::endl;
+        tokenCount++;
+    }, false);
+
+    char buffer[64 * 1024];
+    size_t size = 0;
+    while((size = fread(buffer, 1, sizeof(buffer), stdin)) > 0)
+        lexer.feed(std::string_view(buffer, size));
+    lexer.finish();
+
+    std::cout << tokenCount << " tokens" << std::endl;
+    
+    return 0;
+}
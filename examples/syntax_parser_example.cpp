@@ -22,14 +22,14 @@ int main(int argc, char** argv){
     t.seekg(0);
     t.read(&data[0], size);
 
-    std::shared_ptr<lexpp::SyntaxParser> parser = std::make_shared<lexpp::SyntaxParser>(data);
+    lexpp::SyntaxParser parser(data);
     lexpp::lex(parser);
 
     std::cout << std::setfill(' ') << std::left;
 
     std::cout << std::setw(30) << "Token" << std::setw(30) << "Type" << std::endl;
 
-    for(lexpp::SyntaxToken& token : parser->get_tokens()){
+    for(const lexpp::SyntaxToken& token : parser.get_tokens()){
         std::cout << std::setw(30) << token.value << std::setw(30) << lexpp::to_string(token.type) << std::endl;
     }    
     return 0;
@@ -0,0 +1,37 @@
+#define LEXPP_IMPLEMENTATION
+#include "lexpp.h"
+#include "extensions/token_cache.h"
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <fstream>
+
+int main(int argc, char** argv){
+
+    if(argc <= 2){
+        std::cout << "Usage : lexpp filename cache_directory" << std::endl;
+        exit(-1);
+    }
+    std::ifstream t(argv[1]);
+    std::string data((std::istreambuf_iterator<char>(t)), std::istreambuf_iterator<char>());
+
+    // The first run lexes the file and stores the tokens, later runs on the same content map the cache file
+    lexpp::TokenCache cache(argv[2]);
+    lexpp::TokenCacheKey key = lexpp::token_cache_key(lexpp::syntax_parser_identity(lexpp::CPlusPlus), data);
+    lexpp::CachedTokens cached;
+    if(!cache.load(key, cached)){
+        std::cout << "Not cached yet, lexing " << argv[1] << std::endl;
+        lexpp::SyntaxParser parser(data, lexpp::CPlusPlus);
+        parser.scan();
+        cache.store(key, parser.get_tokens());
+        cache.load(key, cached);
+    }
+
+    // The view reads the tokens straight from the mapped file
+    for(size_t i = 0 ; i < cached.view.size() ; i++){
+        std::cout << cached.view.value(i) << " [" << lexpp::to_string((lexpp::SyntaxTokenType)cached.view.type(i)) << "]" << std::endl;
+    }
+
+    return 0;
+}
@@ -22,10 +22,10 @@ int main(int argc, char** argv){
     t.seekg(0);
     t.read(&data[0], size);
 
-    std::shared_ptr<lexpp::XMLParser> parser = std::make_shared<lexpp::XMLParser>(data);
+    lexpp::XMLParser parser(data);
     lexpp::lex(parser);
 
-    lexpp::XMLDocumentNode* root = parser->get_root_node();
+    lexpp::XMLDocumentNode* root = parser.get_root_node();
 
     std::cout << (*root)["xml-stylesheet"]["CATALOG"]["PLANT"]["COMMON"].value << std::endl;
 
@@ -0,0 +1,287 @@
+/*
+MIT License
+
+Copyright (c) 2021 Jaysmito Mukherjee (jaysmito101@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef LEXPP_MAPPED_FILE_H
+#define LEXPP_MAPPED_FILE_H
+
+#include "../lexpp.h"
+#include <cstring>
+
+#ifdef LEXPP_IMPLEMENTATION
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#endif
+
+namespace lexpp
+{
+
+    // Read only memory mapping of a whole file
+    // Moving it keeps the mapping at the same address so views into data() stay valid
+    class MappedFile
+    {
+        public:
+        MappedFile();
+        MappedFile(const std::string& path);
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile();
+
+        // Returns false if the file could not be opened or mapped, or is not a regular file (a pipe, device, ...)
+        // A regular file that reports a size of 0, like the ones in /proc, is read into memory instead
+        bool open(const std::string& path);
+        void close();
+
+        bool is_open() const { return _isOpen; }
+        std::string_view data() const { return std::string_view(_data, _size); }
+        size_t size() const { return _size; }
+
+        private:
+        const char* _data;
+        size_t _size;
+        bool _isOpen;
+        // Holds the bytes of a file that was read instead of mapped, a heap block so moving keeps its address
+        std::unique_ptr<char[]> _buffer;
+#ifdef _WIN32
+        void* _file;
+        void* _mapping;
+#endif
+    };
+
+    // Tokens lexed from a mapped file, they are views into file so they are valid as long as this is alive
+    template<typename TokenType>
+    struct MappedTokens
+    {
+        MappedFile file;
+        std::vector<TokenType> tokens;
+    };
+
+    // Same as lex_view but reads the file at path through a read only memory mapping
+    // If the file can not be opened file.is_open() is false and there are no tokens
+    MappedTokens<std::string_view> lex_file(const std::string& path, std::string_view separators, bool includeSeparators = false);
+
+    // Same as above with separators of any length, the tokens point into the mapping held by the returned file
+    MappedTokens<std::string_view> lex_file(const std::string& path, const std::vector<std::string>& separators, bool includeSeparators = false);
+
+    // Same as lex_view with a tokenFunction over the mapped file. The TokenViews point into result.file
+    // so they are only valid while the returned MappedTokens (or the MappedFile moved out of it) is alive
+    MappedTokens<TokenView> lex_file(const std::string& path, const std::vector<std::string>& separators, std::function<int(std::string_view, bool*, bool, TokenView*)> tokenFunction, bool includeSeparators = false);
+
+#ifdef LEXPP_IMPLEMENTATION
+
+    // Function Implementations
+
+    MappedTokens<std::string_view> lex_file(const std::string& path, std::string_view separators, bool includeSeparators)
+    {
+        MappedTokens<std::string_view> result;
+        if(result.file.open(path))
+            result.tokens = lex_view(result.file.data(), separators, includeSeparators);
+        return result;
+    }
+
+    MappedTokens<std::string_view> lex_file(const std::string& path, const std::vector<std::string>& separators, bool includeSeparators)
+    {
+        MappedTokens<std::string_view> result;
+        if(result.file.open(path))
+            result.tokens = lex_view(result.file.data(), separators, includeSeparators);
+        return result;
+    }
+
+    MappedTokens<TokenView> lex_file(const std::string& path, const std::vector<std::string>& separators, std::function<int(std::string_view, bool*, bool, TokenView*)> tokenFunction, bool includeSeparators)
+    {
+        MappedTokens<TokenView> result;
+        if(result.file.open(path))
+            result.tokens = lex_view(result.file.data(), separators, tokenFunction, includeSeparators);
+        return result;
+    }
+
+    // Class Implementations
+
+    MappedFile::MappedFile()
+    :_data(nullptr), _size(0), _isOpen(false)
+#ifdef _WIN32
+    , _file(nullptr), _mapping(nullptr)
+#endif
+    {}
+
+    MappedFile::MappedFile(const std::string& path)
+    :MappedFile()
+    {
+        open(path);
+    }
+
+    MappedFile::MappedFile(MappedFile&& other) noexcept
+    :MappedFile()
+    {
+        *this = std::move(other);
+    }
+
+    MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+    {
+        if(this != &other){
+            close();
+            std::swap(_data, other._data);
+            std::swap(_size, other._size);
+            std::swap(_isOpen, other._isOpen);
+            std::swap(_buffer, other._buffer);
+#ifdef _WIN32
+            std::swap(_file, other._file);
+            std::swap(_mapping, other._mapping);
+#endif
+        }
+        return *this;
+    }
+
+    MappedFile::~MappedFile()
+    {
+        close();
+    }
+
+#ifdef _WIN32
+
+    bool MappedFile::open(const std::string& path)
+    {
+        close();
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if(file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        if(GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size)){
+            CloseHandle(file);
+            return false;
+        }
+        _file = file;
+        _size = (size_t)size.QuadPart;
+        // Empty files can not be mapped but are still valid input
+        if(_size > 0){
+            _mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if(_mapping)
+                _data = (const char*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+            if(!_data){
+                close();
+                return false;
+            }
+        }
+        _isOpen = true;
+        return true;
+    }
+
+    void MappedFile::close()
+    {
+        if(_data)
+            UnmapViewOfFile(_data);
+        if(_mapping)
+            CloseHandle((HANDLE)_mapping);
+        if(_file)
+            CloseHandle((HANDLE)_file);
+        _data = nullptr;
+        _mapping = nullptr;
+        _file = nullptr;
+        _size = 0;
+        _isOpen = false;
+    }
+
+#else
+
+    bool MappedFile::open(const std::string& path)
+    {
+        close();
+        // Non blocking so opening a FIFO without a writer does not wait, it is refused below
+        int fd = ::open(path.c_str(), O_RDONLY | O_NONBLOCK);
+        if(fd < 0)
+            return false;
+        struct stat info;
+        if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)){
+            ::close(fd);
+            return false;
+        }
+        _size = (size_t)info.st_size;
+        if(_size == 0){
+            // Empty files can not be mapped but are still valid input, some files only know their size once read.
+            // They are read straight into _buffer, which doubles when it is full
+            size_t capacity = 65536;
+            _buffer.reset(new char[capacity]);
+            ssize_t count;
+            while((count = ::read(fd, _buffer.get() + _size, capacity - _size)) > 0){
+                _size += (size_t)count;
+                if(_size == capacity){
+                    std::unique_ptr<char[]> grown(new char[capacity * 2]);
+                    std::memcpy(grown.get(), _buffer.get(), _size);
+                    _buffer = std::move(grown);
+                    capacity *= 2;
+                }
+            }
+            ::close(fd);
+            if(count < 0 || _size == 0){
+                _buffer.reset();
+                _size = 0;
+                if(count < 0)
+                    return false;
+            }
+            _data = _buffer.get();
+            _isOpen = true;
+            return true;
+        }
+        void* mapping = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapping == MAP_FAILED){
+            ::close(fd);
+            _size = 0;
+            return false;
+        }
+        // The lexers read the mapping front to back once
+        madvise(mapping, _size, MADV_SEQUENTIAL);
+        _data = (const char*)mapping;
+        // The mapping stays valid after the descriptor is closed
+        ::close(fd);
+        _isOpen = true;
+        return true;
+    }
+
+    void MappedFile::close()
+    {
+        if(_data && !_buffer)
+            munmap((void*)_data, _size);
+        _buffer.reset();
+        _data = nullptr;
+        _size = 0;
+        _isOpen = false;
+    }
+
+#endif
+
+#endif
+
+}
+
+#endif
@@ -0,0 +1,386 @@
+/*
+MIT License
+
+Copyright (c) 2021 Jaysmito Mukherjee (jaysmito101@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef LEXPP_PARALLEL_H
+#define LEXPP_PARALLEL_H
+
+#include "../lexpp.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <exception>
+
+namespace lexpp
+{
+
+    // Fixed set of worker threads, parallel_for spreads indices over them with work stealing
+    class ThreadPool
+    {
+        public:
+        // threadCount 0 means one thread per hardware thread
+        ThreadPool(size_t threadCount = 0);
+        ~ThreadPool();
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        size_t thread_count() const { return _threads.size(); }
+
+        // Runs function(i) for every i in [0, count) on the pool and the calling thread, returns when all are done
+        // count has to be below 2^32. If function throws no more indices are started, and once every thread
+        // is out of function the first exception is thrown on the calling thread
+        void parallel_for(size_t count, std::function<void(size_t)> function);
+
+        private:
+        void worker();
+
+        std::vector<std::thread> _threads;
+        std::deque<std::function<void()>> _jobs;
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        bool _stop;
+    };
+
+    // Pool shared by the parallel lexers when none is given
+    ThreadPool& default_thread_pool();
+
+    // Same tokens as lex_view but the input is split into chunks that are lexed on the thread pool
+    // Chunks are only split where no separator can straddle the split, so the result is always identical
+    // There are about 4 chunks per thread of at least 256 KB each, smaller inputs are lexed on the calling thread.
+    // pool nullptr uses default_thread_pool(). The views point into data
+    std::vector<std::string_view> lex_parallel(std::string_view data, std::string_view separators, bool includeSeparators = false, ThreadPool* pool = nullptr);
+
+    // Same as above with separators of any length. With a separator longer than a byte a split is moved forward
+    // to just after a byte that is in no separator, if there is none the chunk takes the rest of the data
+    std::vector<std::string_view> lex_parallel(std::string_view data, const std::vector<std::string>& separators, bool includeSeparators = false, ThreadPool* pool = nullptr);
+
+    // Makes the parser for a document of lex_batch, it is called on the thread that lexes the document
+    typedef std::function<std::shared_ptr<TokenParser>(size_t index, std::string_view document)> TokenParserFactory;
+
+    // Lexes many independent documents on the pool, the result of every document is at its index
+    std::vector<TokenBuffer> lex_batch(const std::vector<std::string_view>& documents, const Lexer& lexer, ThreadPool* pool = nullptr);
+
+    // Calls onDocument(index, tokens) from the thread that lexed the document, so it has to be thread safe
+    void lex_batch(const std::vector<std::string_view>& documents, const Lexer& lexer, std::function<void(size_t, TokenBuffer&)> onDocument, ThreadPool* pool = nullptr);
+
+    // Same as lex(std::shared_ptr<TokenParser>) for every document with a parser made by factory
+    std::vector<std::vector<Token>> lex_batch(const std::vector<std::string_view>& documents, TokenParserFactory factory, ThreadPool* pool = nullptr);
+
+    // Calls onDocument(index, parser, tokens) from the thread that lexed the document, so it has to be thread safe
+    void lex_batch(const std::vector<std::string_view>& documents, TokenParserFactory factory, std::function<void(size_t, std::shared_ptr<TokenParser>&, std::vector<Token>&)> onDocument, ThreadPool* pool = nullptr);
+
+#ifdef LEXPP_IMPLEMENTATION
+
+    // Function Implementations
+
+    ThreadPool& default_thread_pool()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    // Tokens of one chunk and whether its first or last token may continue in the next chunk
+    struct ParallelChunk
+    {
+        std::vector<std::string_view> tokens;
+        bool startsWithToken = false;
+        bool endsWithToken = false;
+    };
+
+    static void lex_chunk(std::string_view chunk, const SeparatorTrie& trie, bool includeSeparators, ParallelChunk& result)
+    {
+        size_t start = scan_separators(chunk, trie, [](size_t, size_t){ return true; }, [&](size_t location, size_t size, bool isSeparator){
+            if(result.tokens.empty() && location == 0 && !isSeparator)
+                result.startsWithToken = true;
+            if(!isSeparator || includeSeparators)
+                result.tokens.push_back(chunk.substr(location, size));
+        });
+        if(chunk.size() > start){
+            if(start == 0)
+                result.startsWithToken = true;
+            result.tokens.push_back(chunk.substr(start));
+            result.endsWithToken = true;
+        }
+    }
+
+    static std::vector<std::string_view> lex_parallel_chunks(std::string_view data, const SeparatorTrie& trie, const CharClass& separatorBytes, bool includeSeparators, ThreadPool* pool)
+    {
+        if(pool == nullptr)
+            pool = &default_thread_pool();
+        // Small inputs are not worth the synchronization
+        const size_t minChunkSize = 256 * 1024;
+        size_t chunkCount = std::min(pool->thread_count() * 4 + 4, data.size() / minChunkSize);
+        if(chunkCount <= 1){
+            ParallelChunk chunk;
+            lex_chunk(data, trie, includeSeparators, chunk);
+            return chunk.tokens;
+        }
+
+        // With only single byte separators every position is a safe split. Otherwise split after a byte that is
+        // in no separator at all, no separator can cover it so the sequential scan also restarts right after it.
+        std::vector<size_t> splits = {0};
+        for(size_t i = 1 ; i < chunkCount ; i++){
+            size_t split = std::max(data.size() / chunkCount * i, splits.back() + 1);
+            if(trie.max_length() > 1){
+                while(split < data.size() && separatorBytes.contains(data[split - 1]))
+                    split++;
+            }
+            if(split >= data.size())
+                break;
+            splits.push_back(split);
+        }
+        splits.push_back(data.size());
+        chunkCount = splits.size() - 1;
+
+        std::vector<ParallelChunk> chunks(chunkCount);
+        pool->parallel_for(chunkCount, [&](size_t i){
+            lex_chunk(data.substr(splits[i], splits[i + 1] - splits[i]), trie, includeSeparators, chunks[i]);
+        });
+
+        // A token cut by a split shows up as the last token of one chunk and the first of the next
+        std::vector<size_t> offsets(chunkCount + 1, 0);
+        std::vector<bool> merged(chunkCount, false);
+        for(size_t i = 0 ; i < chunkCount ; i++){
+            merged[i] = i > 0 && chunks[i - 1].endsWithToken && chunks[i].startsWithToken;
+            offsets[i + 1] = offsets[i] + chunks[i].tokens.size() - (merged[i] ? 1 : 0);
+        }
+        std::vector<std::string_view> tokens(offsets[chunkCount]);
+        pool->parallel_for(chunkCount, [&](size_t i){
+            std::copy(chunks[i].tokens.begin() + (merged[i] ? 1 : 0), chunks[i].tokens.end(), tokens.begin() + offsets[i]);
+        });
+        for(size_t i = 1 ; i < chunkCount ; i++){
+            if(merged[i]){
+                std::string_view& previous = tokens[offsets[i] - 1];
+                std::string_view first = chunks[i].tokens.front();
+                previous = std::string_view(previous.data(), first.data() + first.size() - previous.data());
+            }
+        }
+        return tokens;
+    }
+
+    std::vector<std::string_view> lex_parallel(std::string_view data, std::string_view separators, bool includeSeparators, ThreadPool* pool)
+    {
+        SeparatorTrie trie;
+        for(char separator : separators)
+            trie.insert(std::string_view(&separator, 1));
+        return lex_parallel_chunks(data, trie, CharClass(separators), includeSeparators, pool);
+    }
+
+    std::vector<std::string_view> lex_parallel(std::string_view data, const std::vector<std::string>& separators, bool includeSeparators, ThreadPool* pool)
+    {
+        SeparatorTrie trie(separators);
+        CharClass separatorBytes;
+        for(const std::string& separator : separators){
+            for(char c : separator)
+                separatorBytes.add(c);
+        }
+        return lex_parallel_chunks(data, trie, separatorBytes, includeSeparators, pool);
+    }
+
+    static void lex_document(std::string_view document, const Lexer& lexer, TokenBuffer& tokens)
+    {
+        tokens.set_data(document);
+        lexer.for_each(document, [&](std::string_view token, bool isSeparator){
+            tokens.push_back(token.data() - document.data(), token.size(), isSeparator ? 1 : 0);
+        });
+    }
+
+    std::vector<TokenBuffer> lex_batch(const std::vector<std::string_view>& documents, const Lexer& lexer, ThreadPool* pool)
+    {
+        std::vector<TokenBuffer> results(documents.size());
+        (pool ? pool : &default_thread_pool())->parallel_for(documents.size(), [&](size_t i){
+            lex_document(documents[i], lexer, results[i]);
+        });
+        return results;
+    }
+
+    void lex_batch(const std::vector<std::string_view>& documents, const Lexer& lexer, std::function<void(size_t, TokenBuffer&)> onDocument, ThreadPool* pool)
+    {
+        (pool ? pool : &default_thread_pool())->parallel_for(documents.size(), [&](size_t i){
+            TokenBuffer tokens;
+            lex_document(documents[i], lexer, tokens);
+            onDocument(i, tokens);
+        });
+    }
+
+    std::vector<std::vector<Token>> lex_batch(const std::vector<std::string_view>& documents, TokenParserFactory factory, ThreadPool* pool)
+    {
+        std::vector<std::vector<Token>> results(documents.size());
+        (pool ? pool : &default_thread_pool())->parallel_for(documents.size(), [&](size_t i){
+            results[i] = lex(factory(i, documents[i]));
+        });
+        return results;
+    }
+
+    void lex_batch(const std::vector<std::string_view>& documents, TokenParserFactory factory, std::function<void(size_t, std::shared_ptr<TokenParser>&, std::vector<Token>&)> onDocument, ThreadPool* pool)
+    {
+        (pool ? pool : &default_thread_pool())->parallel_for(documents.size(), [&](size_t i){
+            std::shared_ptr<TokenParser> parser = factory(i, documents[i]);
+            std::vector<Token> tokens = lex(parser);
+            onDocument(i, parser, tokens);
+        });
+    }
+
+    // Class Implementations
+
+    ThreadPool::ThreadPool(size_t threadCount)
+    :_stop(false)
+    {
+        if(threadCount == 0)
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        // The thread calling parallel_for also works so one less is started
+        for(size_t i = 1 ; i < threadCount ; i++)
+            _threads.emplace_back(&ThreadPool::worker, this);
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _condition.notify_all();
+        for(std::thread& thread : _threads)
+            thread.join();
+    }
+
+    void ThreadPool::worker()
+    {
+        while(true){
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _condition.wait(lock, [this]{ return _stop || !_jobs.empty(); });
+                if(_jobs.empty())
+                    return;
+                job = std::move(_jobs.front());
+                _jobs.pop_front();
+            }
+            // Jobs come from parallel_for, which catches what its function throws
+            job();
+        }
+    }
+
+    void ThreadPool::parallel_for(size_t count, std::function<void(size_t)> function)
+    {
+        if(count == 0)
+            return;
+        // Every thread, the caller included, owns a slice of [0, count) and takes indices from its front.
+        // A thread that runs out steals the back half of the slice of another one, so uneven jobs still
+        // keep every thread busy. A slice is one atomic with begin in the high and end in the low 32 bits.
+        // The state is shared because a helper may only get to its job after this call returned.
+        struct alignas(64) Slice
+        {
+            std::atomic<uint64_t> range{0};
+        };
+        struct State
+        {
+            std::vector<Slice> slices;
+            std::atomic<size_t> nextSlice{0};
+            std::atomic<size_t> done{0};
+            // Threads that may still call function, a helper that starts after a failure does not
+            size_t running = 0;
+            std::atomic<bool> failed{false};
+            std::exception_ptr exception;
+            std::mutex mutex;
+            std::condition_variable condition;
+        };
+        const uint64_t mask = 0xffffffff;
+        size_t helpers = std::min(_threads.size(), count - 1);
+        std::shared_ptr<State> state = std::make_shared<State>();
+        state->slices = std::vector<Slice>(helpers + 1);
+        for(size_t i = 0 ; i <= helpers ; i++){
+            uint64_t begin = count * i / (helpers + 1);
+            uint64_t end = count * (i + 1) / (helpers + 1);
+            state->slices[i].range = begin << 32 | end;
+        }
+        auto run = [state, count, mask, &function]{
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if(state->failed)
+                    return;
+                state->running++;
+            }
+            std::vector<Slice>& slices = state->slices;
+            size_t self = state->nextSlice++;
+            size_t finished = 0;
+            try{
+                while(!state->failed){
+                    uint64_t range = slices[self].range.load();
+                    while((range >> 32) < (range & mask) && !state->failed){
+                        if(slices[self].range.compare_exchange_weak(range, range + ((uint64_t)1 << 32))){
+                            function((size_t)(range >> 32));
+                            finished++;
+                            range = slices[self].range.load();
+                        }
+                    }
+                    bool stolen = false;
+                    for(size_t i = 1 ; i < slices.size() && !stolen ; i++){
+                        Slice& victim = slices[(self + i) % slices.size()];
+                        uint64_t victimRange = victim.range.load();
+                        while((victimRange >> 32) < (victimRange & mask)){
+                            uint64_t begin = victimRange >> 32;
+                            uint64_t end = victimRange & mask;
+                            uint64_t middle = begin + (end - begin) / 2;
+                            if(victim.range.compare_exchange_weak(victimRange, begin << 32 | middle)){
+                                slices[self].range.store(middle << 32 | end);
+                                stolen = true;
+                                break;
+                            }
+                        }
+                    }
+                    if(!stolen)
+                        break;
+                }
+            }
+            catch(...){
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if(!state->failed)
+                    state->exception = std::current_exception();
+                state->failed = true;
+            }
+            state->done += finished;
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->running--;
+            state->condition.notify_all();
+        };
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for(size_t i = 0 ; i < helpers ; i++)
+                _jobs.push_back(run);
+        }
+        _condition.notify_all();
+        run();
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->condition.wait(lock, [&]{ return state->done == count || (state->failed && state->running == 0); });
+        if(state->exception)
+            std::rethrow_exception(state->exception);
+    }
+
+#endif
+
+}
+
+#endif
@@ -0,0 +1,545 @@
+/*
+MIT License
+
+Copyright (c) 2021 Jaysmito Mukherjee (jaysmito101@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef LEXPP_RULE_LEXER_H
+#define LEXPP_RULE_LEXER_H
+
+#include "../lexpp.h"
+#include <bitset>
+#include <map>
+
+namespace lexpp
+{
+
+    // A token type and the pattern its tokens match
+    // The pattern is a regex subset : literals, . [abc] [^a-z] ( ) | * + ? and the escapes \d \w \s \D \W \S \n \r \t \0
+    // Any other escaped char is taken literally, use escape_pattern to match a string as it is.
+    // The longest match is found by reading ahead until the DFA dies, then scanning goes on right after the
+    // match. So a pattern that only matches at the end of a long run, like a*b over a's without a b, makes
+    // lexing O(n^2). Patterns that match every prefix of their run, like a+ or \w+, keep it one pass
+    struct LexRule
+    {
+        std::string pattern;
+        int type;
+        // The matches of the rule are consumed but not given out, for whitespace and comments
+        bool discard = false;
+    };
+
+    // Escapes every char of text that has a meaning in a LexRule pattern
+    std::string escape_pattern(std::string_view text);
+
+    // Lexer that splits and classifies in one pass, all the rules are compiled into a single DFA
+    // At every position the longest match wins and a tie goes to the rule that comes first,
+    // a byte no rule matches becomes a one byte token of type Unmatched
+    class RuleLexer
+    {
+        public:
+        static const int Unmatched = -1;
+
+        RuleLexer(const std::vector<LexRule>& rules);
+
+        // False if a pattern could not be parsed, error() tells which one. An invalid lexer matches nothing
+        bool is_valid() const { return _error.empty(); }
+        const std::string& error() const { return _error; }
+
+        // Calls onToken(token, type, location) for every token that is not discarded, it can be inlined
+        template<typename OnToken>
+        void for_each(std::string_view data, OnToken&& onToken) const;
+
+        std::vector<TokenView> lex_view(std::string_view data) const;
+        std::vector<Token> lex(std::string_view data) const;
+        // Unmatched is stored as -1 in the types of the buffer
+        TokenBuffer lex_buffer(std::string_view data) const;
+
+        size_t state_count() const { return _accept.size(); }
+
+        private:
+        bool compile();
+
+        std::vector<LexRule> _rules;
+        std::string _error;
+        // Bytes that no pattern tells apart share a class, so a state has one transition per class
+        uint8_t _byteClass[256];
+        size_t _classCount;
+        // _transitions[state * _classCount + class], state 0 is the dead state and 1 the start state
+        std::vector<int32_t> _transitions;
+        // Index of the rule a state accepts or -1
+        std::vector<int32_t> _accept;
+    };
+
+    // Template implementations
+
+    template<typename OnToken>
+    void RuleLexer::for_each(std::string_view data, OnToken&& onToken) const
+    {
+        LEXPP_STAT_TIMER(lexSeconds);
+        LEXPP_STAT(bytesScanned, data.size());
+        const int32_t* transitions = _transitions.data();
+        const int32_t* accept = _accept.data();
+        const size_t classCount = _classCount;
+        size_t position = 0;
+        while(position < data.size()){
+            // Run the DFA as far as it goes and remember the last accepting state (maximal munch)
+            int32_t state = 1;
+            int32_t rule = -1;
+            size_t length = 0;
+            for(size_t i = position ; i < data.size() ; i++){
+                state = transitions[state * classCount + _byteClass[(unsigned char)data[i]]];
+                if(state == 0)
+                    break;
+                if(accept[state] >= 0){
+                    rule = accept[state];
+                    length = i + 1 - position;
+                }
+            }
+            if(rule < 0){
+                LEXPP_STAT(tokensEmitted, 1);
+                onToken(data.substr(position, 1), Unmatched, position);
+                position++;
+                continue;
+            }
+            if(_rules[rule].discard){
+                LEXPP_STAT(tokensDiscarded, 1);
+            }
+            else{
+                LEXPP_STAT(tokensEmitted, 1);
+                onToken(data.substr(position, length), _rules[rule].type, position);
+            }
+            position += length;
+        }
+    }
+
+#ifdef LEXPP_IMPLEMENTATION
+
+    // Function Implementations
+
+    std::string escape_pattern(std::string_view text)
+    {
+        static const std::string special = "\\.[]()|*+?^-";
+        std::string pattern;
+        for(char c : text){
+            if(special.find(c) != std::string::npos)
+                pattern += '\\';
+            pattern += c;
+        }
+        return pattern;
+    }
+
+    // Thompson NFA built from the patterns, every state has epsilon edges and at most one byte set edge
+    struct RuleNfa
+    {
+        struct State
+        {
+            std::vector<int> epsilon;
+            std::bitset<256> bytes;
+            int next = -1;
+            int rule = -1;
+        };
+
+        // A piece of the automaton with one way in and one way out
+        struct Fragment
+        {
+            int start;
+            int end;
+        };
+
+        int add_state()
+        {
+            states.emplace_back();
+            return (int)states.size() - 1;
+        }
+
+        Fragment byte_set(const std::bitset<256>& bytes)
+        {
+            int start = add_state();
+            int end = add_state();
+            states[start].bytes = bytes;
+            states[start].next = end;
+            return {start, end};
+        }
+
+        Fragment empty()
+        {
+            int state = add_state();
+            return {state, state};
+        }
+
+        std::vector<State> states;
+    };
+
+    // Recursive descent over a pattern, sets error and returns false on a syntax error
+    class RulePatternParser
+    {
+        public:
+        RulePatternParser(RuleNfa& nfa, std::string_view pattern)
+        :_nfa(nfa), _pattern(pattern), _position(0)
+        {}
+
+        bool parse(RuleNfa::Fragment& fragment)
+        {
+            if(!alternation(fragment))
+                return false;
+            if(_position < _pattern.size())
+                return fail(_pattern[_position] == ')' ? "unbalanced )" : "unexpected char");
+            return true;
+        }
+
+        std::string error;
+
+        private:
+        bool fail(const char* message)
+        {
+            error = std::string(message) + " at " + std::to_string(_position);
+            return false;
+        }
+
+        bool alternation(RuleNfa::Fragment& fragment)
+        {
+            if(!sequence(fragment))
+                return false;
+            while(_position < _pattern.size() && _pattern[_position] == '|'){
+                _position++;
+                RuleNfa::Fragment other;
+                if(!sequence(other))
+                    return false;
+                int start = _nfa.add_state();
+                int end = _nfa.add_state();
+                _nfa.states[start].epsilon = {fragment.start, other.start};
+                _nfa.states[fragment.end].epsilon.push_back(end);
+                _nfa.states[other.end].epsilon.push_back(end);
+                fragment = {start, end};
+            }
+            return true;
+        }
+
+        bool sequence(RuleNfa::Fragment& fragment)
+        {
+            fragment = _nfa.empty();
+            while(_position < _pattern.size() && _pattern[_position] != '|' && _pattern[_position] != ')'){
+                RuleNfa::Fragment next;
+                if(!repetition(next))
+                    return false;
+                _nfa.states[fragment.end].epsilon.push_back(next.start);
+                fragment.end = next.end;
+            }
+            return true;
+        }
+
+        bool repetition(RuleNfa::Fragment& fragment)
+        {
+            if(!atom(fragment))
+                return false;
+            while(_position < _pattern.size()){
+                char op = _pattern[_position];
+                if(op != '*' && op != '+' && op != '?')
+                    break;
+                _position++;
+                int start = _nfa.add_state();
+                int end = _nfa.add_state();
+                _nfa.states[start].epsilon.push_back(fragment.start);
+                _nfa.states[fragment.end].epsilon.push_back(end);
+                if(op != '+')
+                    _nfa.states[start].epsilon.push_back(end);
+                if(op != '?')
+                    _nfa.states[fragment.end].epsilon.push_back(fragment.start);
+                fragment = {start, end};
+            }
+            return true;
+        }
+
+        bool atom(RuleNfa::Fragment& fragment)
+        {
+            char c = _pattern[_position++];
+            std::bitset<256> bytes;
+            if(c == '('){
+                if(!alternation(fragment))
+                    return false;
+                if(_position >= _pattern.size() || _pattern[_position] != ')')
+                    return fail("missing )");
+                _position++;
+                return true;
+            }
+            else if(c == '['){
+                if(!char_class(bytes))
+                    return false;
+            }
+            else if(c == '.'){
+                bytes.set();
+                bytes.reset('\n');
+            }
+            else if(c == '\\'){
+                if(!escape(bytes))
+                    return false;
+            }
+            else if(c == '*' || c == '+' || c == '?'){
+                _position--;
+                return fail("nothing to repeat");
+            }
+            else
+                bytes.set((unsigned char)c);
+            fragment = _nfa.byte_set(bytes);
+            return true;
+        }
+
+        bool escape(std::bitset<256>& bytes)
+        {
+            if(_position >= _pattern.size())
+                return fail("trailing \\");
+            char c = _pattern[_position++];
+            bool negate = (c == 'D' || c == 'W' || c == 'S');
+            switch(c){
+                case 'd': case 'D':
+                    for(int b = '0' ; b <= '9' ; b++) bytes.set(b);
+                    break;
+                case 'w': case 'W':
+                    for(int b = '0' ; b <= '9' ; b++) bytes.set(b);
+                    for(int b = 'a' ; b <= 'z' ; b++) bytes.set(b);
+                    for(int b = 'A' ; b <= 'Z' ; b++) bytes.set(b);
+                    bytes.set('_');
+                    break;
+                case 's': case 'S':
+                    for(char b : std::string(" \t\n\r\f\v")) bytes.set((unsigned char)b);
+                    break;
+                case 'n': bytes.set('\n'); break;
+                case 'r': bytes.set('\r'); break;
+                case 't': bytes.set('\t'); break;
+                case '0': bytes.set(0); break;
+                default: bytes.set((unsigned char)c); break;
+            }
+            if(negate)
+                bytes.flip();
+            return true;
+        }
+
+        bool char_class(std::bitset<256>& bytes)
+        {
+            bool negate = _position < _pattern.size() && _pattern[_position] == '^';
+            if(negate)
+                _position++;
+            bool first = true;
+            while(_position < _pattern.size() && (_pattern[_position] != ']' || first)){
+                first = false;
+                std::bitset<256> single;
+                unsigned char low = (unsigned char)_pattern[_position++];
+                if(low == '\\'){
+                    if(!escape(single))
+                        return false;
+                    // A range can only start at an escape of one char
+                    if(single.count() != 1){
+                        bytes |= single;
+                        continue;
+                    }
+                    for(int b = 0 ; b < 256 ; b++)
+                        if(single.test(b))
+                            low = (unsigned char)b;
+                }
+                unsigned char high = low;
+                if(_position + 1 < _pattern.size() && _pattern[_position] == '-' && _pattern[_position + 1] != ']'){
+                    _position++;
+                    high = (unsigned char)_pattern[_position++];
+                    if(high == '\\'){
+                        // single still holds the start of the range
+                        single.reset();
+                        if(!escape(single) || single.count() != 1)
+                            return fail("bad range");
+                        for(int b = 0 ; b < 256 ; b++)
+                            if(single.test(b))
+                                high = (unsigned char)b;
+                    }
+                    if(high < low)
+                        return fail("bad range");
+                }
+                for(int b = low ; b <= high ; b++)
+                    bytes.set(b);
+            }
+            if(_position >= _pattern.size())
+                return fail("missing ]");
+            _position++;
+            if(negate)
+                bytes.flip();
+            return true;
+        }
+
+        RuleNfa& _nfa;
+        std::string_view _pattern;
+        size_t _position;
+    };
+
+    // Class Implementations
+
+    RuleLexer::RuleLexer(const std::vector<LexRule>& rules)
+    :_rules(rules), _classCount(1)
+    {
+        std::fill(_byteClass, _byteClass + 256, 0);
+        if(!compile()){
+            // Only the dead state so every byte is Unmatched
+            std::fill(_byteClass, _byteClass + 256, 0);
+            _classCount = 1;
+            _transitions.assign(2, 0);
+            _accept.assign(2, -1);
+        }
+    }
+
+    bool RuleLexer::compile()
+    {
+        RuleNfa nfa;
+        int start = nfa.add_state();
+        for(size_t i = 0 ; i < _rules.size() ; i++){
+            if(_rules[i].pattern.empty()){
+                _error = "rule " + std::to_string(i) + " : empty pattern";
+                return false;
+            }
+            RulePatternParser parser(nfa, _rules[i].pattern);
+            RuleNfa::Fragment fragment;
+            if(!parser.parse(fragment)){
+                _error = "rule " + std::to_string(i) + " : " + parser.error;
+                return false;
+            }
+            nfa.states[fragment.end].rule = (int)i;
+            nfa.states[start].epsilon.push_back(fragment.start);
+        }
+
+        // Bytes with the same membership in every byte set of the NFA behave the same everywhere
+        std::vector<const std::bitset<256>*> sets;
+        for(const RuleNfa::State& state : nfa.states)
+            if(state.next >= 0)
+                sets.push_back(&state.bytes);
+        std::map<std::vector<bool>, uint8_t> classes;
+        for(int b = 0 ; b < 256 ; b++){
+            std::vector<bool> signature(sets.size());
+            for(size_t i = 0 ; i < sets.size() ; i++)
+                signature[i] = sets[i]->test(b);
+            auto it = classes.emplace(signature, (uint8_t)classes.size()).first;
+            _byteClass[b] = it->second;
+        }
+        _classCount = classes.size();
+        // A representative byte of every class
+        std::vector<int> representative(_classCount);
+        for(int b = 255 ; b >= 0 ; b--)
+            representative[_byteClass[b]] = b;
+
+        auto closure = [&nfa](std::vector<int> states){
+            std::vector<bool> seen(nfa.states.size(), false);
+            std::vector<int> stack = states;
+            for(int state : states)
+                seen[state] = true;
+            while(!stack.empty()){
+                int state = stack.back();
+                stack.pop_back();
+                for(int next : nfa.states[state].epsilon){
+                    if(!seen[next]){
+                        seen[next] = true;
+                        states.push_back(next);
+                        stack.push_back(next);
+                    }
+                }
+            }
+            std::sort(states.begin(), states.end());
+            return states;
+        };
+
+        // Subset construction, the DFA state of a set of NFA states is found through the map
+        std::map<std::vector<int>, int32_t> ids;
+        std::vector<std::vector<int>> stateSets;
+        ids[std::vector<int>()] = 0;
+        stateSets.push_back(std::vector<int>());
+        std::vector<int> initial = closure({start});
+        ids[initial] = 1;
+        stateSets.push_back(initial);
+        _transitions.assign(2 * _classCount, 0);
+        const size_t maxStates = 1 << 16;
+        for(size_t current = 1 ; current < stateSets.size() ; current++){
+            for(size_t byteClass = 0 ; byteClass < _classCount ; byteClass++){
+                int b = representative[byteClass];
+                std::vector<int> moved;
+                for(int state : stateSets[current]){
+                    const RuleNfa::State& nfaState = nfa.states[state];
+                    if(nfaState.next >= 0 && nfaState.bytes.test(b))
+                        moved.push_back(nfaState.next);
+                }
+                if(moved.empty())
+                    continue;
+                moved = closure(moved);
+                auto it = ids.find(moved);
+                int32_t id;
+                if(it == ids.end()){
+                    if(stateSets.size() >= maxStates){
+                        _error = "the rules need more than " + std::to_string(maxStates) + " states";
+                        return false;
+                    }
+                    id = (int32_t)stateSets.size();
+                    ids.emplace(moved, id);
+                    stateSets.push_back(moved);
+                    _transitions.resize(stateSets.size() * _classCount, 0);
+                }
+                else
+                    id = it->second;
+                _transitions[current * _classCount + byteClass] = id;
+            }
+        }
+
+        // The first rule wins when a state accepts more than one
+        _accept.assign(stateSets.size(), -1);
+        for(size_t i = 1 ; i < stateSets.size() ; i++){
+            for(int state : stateSets[i]){
+                int rule = nfa.states[state].rule;
+                if(rule >= 0 && (_accept[i] < 0 || rule < _accept[i]))
+                    _accept[i] = rule;
+            }
+        }
+        return true;
+    }
+
+    std::vector<TokenView> RuleLexer::lex_view(std::string_view data) const
+    {
+        std::vector<TokenView> tokens;
+        for_each(data, [&tokens](std::string_view token, int type, size_t location){
+            emplace_token(tokens, TokenView{token, type, nullptr, location});
+        });
+        return tokens;
+    }
+
+    std::vector<Token> RuleLexer::lex(std::string_view data) const
+    {
+        std::vector<Token> tokens;
+        for_each(data, [&tokens](std::string_view token, int type, size_t location){
+            emplace_token(tokens, Token{std::string(token), type, nullptr, (int)location});
+        });
+        return tokens;
+    }
+
+    TokenBuffer RuleLexer::lex_buffer(std::string_view data) const
+    {
+        TokenBuffer buffer(data);
+        for_each(data, [&buffer](std::string_view token, int type, size_t location){
+            buffer.push_back(location, token.size(), type);
+        });
+        return buffer;
+    }
+
+#endif
+
+}
+
+#endif
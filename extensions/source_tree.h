@@ -0,0 +1,247 @@
+/*
+MIT License
+
+Copyright (c) 2021 Jaysmito Mukherjee (jaysmito101@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef LEXPP_SOURCE_TREE_H
+#define LEXPP_SOURCE_TREE_H
+
+#include "../lexpp.h"
+#include "parallel.h"
+#include "syntax_parser.h"
+#include <unordered_map>
+#include <filesystem>
+#include <fstream>
+#include <exception>
+
+namespace lexpp
+{
+
+    // Language of a file by its extension with the dot, like ".cpp"
+    typedef std::unordered_map<std::string, SyntaxParserLanguage> SyntaxLanguageMap;
+
+    // The usual extensions of every SyntaxParserLanguage
+    SyntaxLanguageMap default_language_map();
+
+    // A lexed file given to the sink of lex_tree
+    struct SourceFile
+    {
+        std::string path;
+        // Order in which the file was found, the sink gets the files in the order they are done
+        size_t index = 0;
+        SyntaxParserLanguage language = SyntaxParserLanguage::C;
+        // Text of the file, only valid during the call to the sink
+        std::string_view data;
+        std::vector<SyntaxToken> tokens;
+    };
+
+    // Called from the thread that lexed the file so it has to be thread safe, the tokens can be moved out.
+    // If it throws no more files are given to it and lex_tree rethrows the first exception once its threads are done
+    typedef std::function<void(SourceFile&)> SourceFileSink;
+
+    // Lexes every file under root that has an extension in languages with SyntaxParser::scan.
+    // A reader thread walks the tree and reads files ahead of the lexing, at most prefetch files are read
+    // and not yet lexed. The files are lexed on the pool. Returns the number of files given to sink,
+    // files and directories that can not be read are skipped
+    size_t lex_tree(const std::string& root, const SyntaxLanguageMap& languages, SourceFileSink sink, ThreadPool* pool = nullptr, size_t prefetch = 64);
+
+#ifdef LEXPP_IMPLEMENTATION
+
+    // Function Implementations
+
+    SyntaxLanguageMap default_language_map()
+    {
+        return {
+            {".c", C}, {".h", C}, {".cpp", CPlusPlus}, {".cxx", CPlusPlus}, {".cc", CPlusPlus}, {".hpp", CPlusPlus}, {".hh", CPlusPlus},
+            {".java", Java}, {".py", Python}, {".cs", CSharp}, {".rs", Rust}, {".go", Go}, {".glsl", GLSL}, {".hlsl", HLSL},
+            {".js", JavaScript}, {".mjs", JavaScript}, {".lua", Lua}, {".coffee", CoffeeScript}, {".ts", TypeScript},
+            {".swift", Swift}, {".kt", Kotlin}, {".m", ObjectiveC}, {".mm", ObjectiveCPlusPlus}, {".as", ActionScript}, {".scala", Scala}
+        };
+    }
+
+    // A read file waiting to be lexed
+    struct SourceTreeJob
+    {
+        std::string path;
+        size_t index;
+        SyntaxParserLanguage language;
+        std::string data;
+    };
+
+    // Queue between the reader and the lexing threads, push waits while it is full
+    struct SourceTreeQueue
+    {
+        std::deque<SourceTreeJob> jobs;
+        size_t capacity;
+        bool closed = false;
+        bool stopped = false;
+        std::mutex mutex;
+        std::condition_variable notFull;
+        std::condition_variable notEmpty;
+
+        // False once the queue is stopped, the job is dropped then
+        bool push(SourceTreeJob job)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notFull.wait(lock, [this]{ return stopped || jobs.size() < capacity; });
+            if(stopped)
+                return false;
+            jobs.push_back(std::move(job));
+            notEmpty.notify_one();
+            return true;
+        }
+
+        void close()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            notEmpty.notify_all();
+        }
+
+        // Drops the waiting jobs and wakes everyone, pop and push fail from now on
+        void stop()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+            closed = true;
+            jobs.clear();
+            notFull.notify_all();
+            notEmpty.notify_all();
+        }
+
+        // False once the queue is closed and empty
+        bool pop(SourceTreeJob& job)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notEmpty.wait(lock, [this]{ return closed || !jobs.empty(); });
+            if(jobs.empty())
+                return false;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            notFull.notify_one();
+            return true;
+        }
+    };
+
+    static bool read_source_file(const std::filesystem::path& path, std::string& data)
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if(!file)
+            return false;
+        std::streamoff size = file.tellg();
+        if(size < 0)
+            return false;
+        data.resize((size_t)size);
+        file.seekg(0);
+        return (bool)file.read(&data[0], size) || size == 0;
+    }
+
+    static void read_source_tree(const std::string& root, const SyntaxLanguageMap& languages, SourceTreeQueue& queue)
+    {
+        namespace fs = std::filesystem;
+        std::error_code error;
+        size_t index = 0;
+        fs::recursive_directory_iterator it(root, fs::directory_options::skip_permission_denied, error);
+        fs::recursive_directory_iterator end;
+        while(!error && it != end){
+            std::error_code fileError;
+            auto language = languages.find(it->path().extension().string());
+            if(language != languages.end() && it->is_regular_file(fileError)){
+                SourceTreeJob job;
+                if(read_source_file(it->path(), job.data)){
+                    job.path = it->path().string();
+                    job.index = index++;
+                    job.language = language->second;
+                    if(!queue.push(std::move(job)))
+                        return;
+                }
+            }
+            it.increment(error);
+            // A directory that can not be opened is skipped, if that fails too the rest of its parent is
+            if(error && it != end){
+                error.clear();
+                it.disable_recursion_pending();
+                it.increment(error);
+                if(error && it != end && it.depth() > 0){
+                    error.clear();
+                    it.pop(error);
+                }
+            }
+        }
+        queue.close();
+    }
+
+    size_t lex_tree(const std::string& root, const SyntaxLanguageMap& languages, SourceFileSink sink, ThreadPool* pool, size_t prefetch)
+    {
+        if(pool == nullptr)
+            pool = &default_thread_pool();
+        SourceTreeQueue queue;
+        queue.capacity = std::max<size_t>(prefetch, 1);
+        std::thread reader(read_source_tree, std::cref(root), std::cref(languages), std::ref(queue));
+
+        // Every thread of the pool takes files until the reader is done, a parser is reused for all its files.
+        // The first exception stops the queue so the other threads and the reader finish, it is thrown once the reader is joined
+        std::atomic<size_t> count{0};
+        std::exception_ptr exception;
+        std::mutex exceptionMutex;
+        try{
+            pool->parallel_for(pool->thread_count() + 1, [&](size_t){
+                try{
+                    SyntaxParser parser("", C);
+                    SourceTreeJob job;
+                    while(queue.pop(job)){
+                        parser.reset(std::move(job.data), job.language);
+                        parser.scan();
+                        SourceFile file;
+                        file.path = std::move(job.path);
+                        file.index = job.index;
+                        file.language = job.language;
+                        file.data = parser.data();
+                        file.tokens = parser.take_tokens();
+                        sink(file);
+                        count++;
+                    }
+                }
+                catch(...){
+                    std::lock_guard<std::mutex> lock(exceptionMutex);
+                    if(!exception)
+                        exception = std::current_exception();
+                    queue.stop();
+                }
+            });
+        }
+        catch(...){
+            queue.stop();
+            reader.join();
+            throw;
+        }
+        reader.join();
+        if(exception)
+            std::rethrow_exception(exception);
+        return count;
+    }
+
+#endif
+
+}
+
+#endif
@@ -27,6 +27,9 @@ SOFTWARE.
 
 #include "../lexpp.h"
 
+#include <mutex>
+#include <unordered_set>
+
 namespace lexpp
 {
 
@@ -70,8 +73,72 @@ namespace lexpp
         std::string value = "";
         SyntaxTokenType type = SyntaxTokenType::None;
         void* userdata = nullptr;
+        // Byte offset in the data where the text of the token starts
+        int location = -1;
+    };
+
+    // A point of the data where SyntaxParser::scan had no token pending, scanning can start again from it
+    struct SyntaxCheckpoint{
+        size_t location = 0;
+        // Number of tokens before location
+        size_t tokenIndex = 0;
+    };
+
+    // An opening brace token and the closing one that matches it
+    struct SyntaxBracePair{
+        static constexpr size_t Unmatched = (size_t)-1;
+        // Indices into the tokens of the parser, close is Unmatched if the brace is never closed
+        size_t open = 0;
+        size_t close = Unmatched;
+        // Number of braces open around this one, 0 at the top level
+        size_t depth = 0;
+    };
+
+    // Keyword lookup with a perfect hash, a seed is searched so no two keywords share a slot
+    // A lookup hashes the word and compares at most one string. If no seed is found in a bounded search
+    // the keywords are kept sorted and looked up with a binary search instead
+    class KeywordSet
+    {
+        public:
+        KeywordSet() {}
+        KeywordSet(const std::vector<std::string>& keywords);
+
+        bool contains(std::string_view word) const;
+        size_t size() const { return _keywords.size(); }
+
+        private:
+        uint32_t slot(std::string_view word) const;
+
+        std::vector<std::string> _keywords;
+        // Index + 1 into _keywords for every slot, 0 for an empty slot. Empty if the sorted fallback is used
+        std::vector<uint16_t> _slots;
+        uint32_t _mask = 0;
+        uint32_t _seed = 0;
+        // Bit n is set if some keyword is n bytes long, so most identifiers are rejected without hashing
+        uint64_t _lengths = 0;
+    };
+
+    // The separators, keywords and operators of a language with the lookups built from them.
+    // Built once per language on first use and shared read only by every SyntaxParser
+    struct SyntaxLanguageTables{
+        SyntaxLanguageTables() {}
+        SyntaxLanguageTables(std::vector<std::string> separators, std::vector<std::string> keywords, std::vector<std::string> operators);
+
+        std::vector<std::string> separators;
+        std::vector<std::string> keywords;
+        std::vector<std::string> operators;
+        KeywordSet keywordSet;
+        SeparatorTrie operatorTrie;
+
+        // A language out of the enum gets no keywords
+        static const SyntaxLanguageTables& get(SyntaxParserLanguage language);
     };
 
+    // Separators and operators are the same for every language
+    std::vector<std::string> syntax_separators(SyntaxParserLanguage);
+    std::vector<std::string> syntax_keywords(SyntaxParserLanguage language);
+    std::vector<std::string> syntax_operators(SyntaxParserLanguage);
+
     std::string to_string(SyntaxTokenType type);
 
     std::string to_string(SyntaxParserLanguage language);
@@ -83,33 +150,118 @@ namespace lexpp
     class SyntaxParser : public TokenParser{
         public:
         SyntaxParser(std::string data, SyntaxParserLanguage language);
+
+        // Starts over with new data keeping the allocated buffers, for parsers reused from a SyntaxParserPool
+        void reset(std::string data, SyntaxParserLanguage language);
         
         virtual int process_token(std::string& token, bool* discard, bool isSeparator, Token* tok) override;
 
+        // Gives out the token that was still being built when the data ended
+        virtual void on_end() override;
+
         virtual bool accept_token();
         virtual void on_token(std::string& token, bool* discard, bool isSeparator, Token* tok);
 
-        std::vector<SyntaxToken> get_tokens();
+        // Lexes the data in a single pass over a byte class table instead of lex(*this), the tokens are the same
+        // but on_token is not called. If a separator is longer than a byte it falls back to lexing through the
+        // virtual functions, then the overrides of a derived parser and on_token are called as in lex.
+        // Replaces the tokens of an earlier lex or scan
+        void scan();
+
+        // Replaces removed bytes at offset of the data with text and updates the tokens of the last scan.
+        // Scanning starts again at the last checkpoint before the edit and stops at the first old
+        // checkpoint after it where the state is the same, the tokens in between are spliced in
+        void edit(size_t offset, size_t removed, std::string_view text);
+
+        // Checkpoints are kept about every interval bytes, the next scan uses a new interval
+        void set_checkpoint_interval(size_t interval) { _checkpointInterval = std::max<size_t>(interval, 1); }
+        const std::vector<SyntaxCheckpoint>& get_checkpoints() const { return _checkpoints; }
 
+        std::vector<SyntaxToken>& get_tokens() { return _synaxTokens; }
+        // Moves the tokens out of the parser, it has none after this
+        std::vector<SyntaxToken> take_tokens();
+
+        // Every {, ( and [ token in order with the index of its closing token and its depth, built while lexing.
+        // A closing brace that does not match the innermost open one is not paired
+        const std::vector<SyntaxBracePair>& get_brace_pairs();
+        // The pair of the opening brace at tokenIndex or nullptr if that token is not one
+        const SyntaxBracePair* find_brace_pair(size_t tokenIndex);
+
+        // They return _operators, _keywords and _separators. A parser that overrides them or changes those members
+        // lexes with its own tables built from them on the first lex or scan, otherwise the shared tables of the language are used
         virtual std::vector<std::string> get_operators();
         virtual std::vector<std::string> get_keywords();
         virtual std::vector<std::string> get_separators();
 
         private:
-        bool is_number(std::string& s);
+        // Points _tables at tables built from the getters if they differ from the shared ones and fills the members from _tables
+        void resolve_tables();
+        // Fills _separators, _keywords and _operators from _tables
+        void fill_table_members();
+        bool is_number(std::string_view s);
+        bool ends_with_escape(std::string_view value);
         void push_token();
+        // Adds the brace token that is about to be pushed at index to the brace pairs
+        void index_brace(char brace, size_t index);
+        void clear_brace_pairs();
+        // Adds a byte of an operator at location, the operators are found by maximal munch
+        void push_operator_char(char c, int location);
+        // Gives out the literal after the quote at begin, stops holds the quote and the backslash
+        // Returns the position after the closing quote
+        const char* scan_literal(const char* begin, const char* end, const CharClass& stops);
+        // Fills the class of every byte for scan_from, false if a separator is longer than a byte
+        bool build_scan_classes(uint8_t* classes);
+        // Scans from location, where nothing is pending, to the end of the data or to the first checkpoint
+        // of resync moved by delta that is reached at or after resyncAfter with nothing pending.
+        // Returns the index of that checkpoint in resync or resync.size() if the end was reached
+        size_t scan_from(const uint8_t* classes, size_t location, const std::vector<SyntaxCheckpoint>& resync, long long delta, size_t resyncAfter);
+
+        enum ScanClass : uint8_t { ScanWord, ScanBreak, ScanDot, ScanOperator, ScanBrace, ScanQuote, ScanApostrophe };
 
         protected:
+        // The shared tables of _language or _ownTables
+        const SyntaxLanguageTables* _tables = nullptr;
+        // Shared so a copied parser keeps them
+        std::shared_ptr<const SyntaxLanguageTables> _ownTables;
+        // Set once resolve_tables has asked the getters, reset with the language
+        bool _tablesResolved = false;
+        // Filled from the tables of the language like _separators, changes made before the first lex or scan are used
         std::vector<std::string> _keywords;
         std::vector<std::string> _operators;
+        // Node of _operatorTrie for the operator text in _currentToken, -1 if no operator starts with it
+        int _operatorNode = -1;
         SyntaxParserLanguage _language;
         SyntaxToken _currentToken;
         std::vector<SyntaxToken> _synaxTokens;
+        // Filled by scan, ordered by location
+        std::vector<SyntaxCheckpoint> _checkpoints;
+        size_t _checkpointInterval = 4096;
+        std::vector<SyntaxBracePair> _bracePairs;
+        // Indices into _bracePairs of the braces that are open
+        std::vector<size_t> _openBraces;
+        // Set by edit, the pairs are built again from the tokens when they are asked for
+        bool _bracePairsDirty = false;
+        // Location of the piece given to process_token
+        int _location = 0;
         // Flags
         bool isInString = false;
         bool isInChar = false;
     };
 
+    // Keeps parsers that are done with so the next ones reuse their buffers, can be shared between threads
+    class SyntaxParserPool
+    {
+        public:
+        // A parser for data from the pool or a new one if the pool is empty
+        std::unique_ptr<SyntaxParser> acquire(std::string data, SyntaxParserLanguage language);
+        void release(std::unique_ptr<SyntaxParser> parser);
+        size_t size();
+
+        private:
+        std::mutex _mutex;
+        std::vector<std::unique_ptr<SyntaxParser>> _parsers;
+    };
+
 #ifdef LEXPP_IMPLEMENTATION
 
     // Function Implementations
@@ -173,47 +325,19 @@ namespace lexpp
         return os;
     }
 
-    // Class Implementations
-
-    SyntaxParser::SyntaxParser(std::string data, SyntaxParserLanguage language = SyntaxParserLanguage::C)
+    std::vector<std::string> syntax_separators(SyntaxParserLanguage)
     {
-        _data = data;
-        _language = language;
-        _separators = get_separators();
-        _keywords = get_keywords();
-        _operators = get_operators();
-        _includeSeparators = true;
-    }
-
-    bool SyntaxParser::accept_token()
-    {
-        // This is meant to be overridden if needed
-        return true;
-    }
-
-    void SyntaxParser::on_token(std::string& token, bool* discard, bool isSeparator, Token* tok)
-    {
-        // This is meant to be overridden if needed
-    }
-
-    std::vector<SyntaxToken> SyntaxParser::get_tokens()
-    {
-        return _synaxTokens;
-    }
-
-    std::vector<std::string> SyntaxParser::get_separators()
-    {
-        return {" ", "\n", ".", "!", "\t", ";", ":", "\\", "/", "+", "-", "*", "&", "%", "<", ">", "=", "(", ")", "{", "}", "[", "]", "\"", "\'", ","};
+        return {" ", "\n", ".", "!", "\t", ";", ":", "\\", "/", "+", "-", "*", "&", "%", "<", ">", "=", "(", ")", "{", "}", "[", "]", "\"", "\'", ",", "|", "^", "?", "~", "\r"};
     }
 
-    std::vector<std::string> SyntaxParser::get_operators()
+    std::vector<std::string> syntax_operators(SyntaxParserLanguage)
     {
-        return {"+", "-", "*", "/", "=", "<", ">", "!", "?", ":", "::", "->", "<=", ">=", "+=", "-=", "/=", "*=", "^", "^=", "&", "&&", "==", "&=", "||", "|", "%", "%="};
+        return {"+", "-", "*", "/", "=", "<", ">", "!", "?", ":", "::", "->", "<=", ">=", "+=", "-=", "/=", "*=", "^", "^=", "&", "&&", "==", "&=", "||", "|", "%", "%=",
+                "~", "!=", "|=", "++", "--", "<<", ">>", "<<=", ">>=", "<=>", "->*", "&&=", "||=", "===", "!==", "=>", "??", "?\?="};
     }
 
-    std::vector<std::string> SyntaxParser::get_keywords()
+    std::vector<std::string> syntax_keywords(SyntaxParserLanguage language)
     {
-        SyntaxParserLanguage language = _language;
         // NOTE : The List of Keywords are generated by GitHub Copilot and I have not look through them individually so there might be some problems!
         if(language == SyntaxParserLanguage::C)
         {
@@ -272,60 +396,572 @@ namespace lexpp
         return {};
     }
 
-    void SyntaxParser::push_token()
+    // Class Implementations
+
+    KeywordSet::KeywordSet(const std::vector<std::string>& keywords)
     {
-        if(_currentToken.type != SyntaxTokenType::None && _currentToken.value.size() > 0)
+        std::unordered_set<std::string_view> seen;
+        for(const std::string& keyword : keywords){
+            if(keyword.empty() || !seen.insert(keyword).second)
+                continue;
+            _keywords.push_back(keyword);
+            _lengths |= (uint64_t)1 << std::min<size_t>(keyword.size(), 63);
+        }
+        if(_keywords.empty())
+            return;
+        // Start with about 4 slots per keyword and grow until some seed puts every keyword in its own slot.
+        // The table grows at most 64 times, a slot holds a 16 bit index so more keywords than that can not be hashed
+        size_t tableSize = 8;
+        while(tableSize < _keywords.size() * 4)
+            tableSize *= 2;
+        const size_t maxTableSize = tableSize * 64;
+        for( ; _keywords.size() < UINT16_MAX && tableSize <= maxTableSize ; tableSize *= 2){
+            _mask = (uint32_t)tableSize - 1;
+            for(_seed = 1 ; _seed <= 256 ; _seed++){
+                _slots.assign(tableSize, 0);
+                bool perfect = true;
+                for(size_t i = 0 ; i < _keywords.size() && perfect ; i++){
+                    uint16_t& entry = _slots[slot(_keywords[i])];
+                    perfect = (entry == 0);
+                    entry = (uint16_t)(i + 1);
+                }
+                if(perfect)
+                    return;
+            }
+        }
+        _slots.clear();
+        _mask = 0;
+        std::sort(_keywords.begin(), _keywords.end());
+    }
+
+    uint32_t KeywordSet::slot(std::string_view word) const
+    {
+        // Keywords are short so hashing every byte costs little and any two of them can be told apart
+        uint32_t h = _seed * 0x9e3779b9u;
+        for(char c : word)
+            h = (h ^ (unsigned char)c) * 0x01000193u;
+        return (h ^ (h >> 15)) & _mask;
+    }
+
+    bool KeywordSet::contains(std::string_view word) const
+    {
+        if(word.empty() || !((_lengths >> std::min<size_t>(word.size(), 63)) & 1))
+            return false;
+        if(_slots.empty())
+            return std::binary_search(_keywords.begin(), _keywords.end(), word);
+        uint16_t entry = _slots[slot(word)];
+        return entry != 0 && _keywords[entry - 1] == word;
+    }
+
+    const SyntaxLanguageTables& SyntaxLanguageTables::get(SyntaxParserLanguage language)
+    {
+        // Every language is built on the first call, the initialization of a static is thread safe
+        static const std::vector<SyntaxLanguageTables> tables = []{
+            std::vector<SyntaxLanguageTables> result(SyntaxParserLanguage::Scala + 1);
+            for(int i = 0 ; i < (int)result.size() ; i++)
+                result[i] = SyntaxLanguageTables(syntax_separators((SyntaxParserLanguage)i), syntax_keywords((SyntaxParserLanguage)i), syntax_operators((SyntaxParserLanguage)i));
+            return result;
+        }();
+        if((size_t)language < tables.size())
+            return tables[language];
+        static const SyntaxLanguageTables unknown(syntax_separators(language), {}, syntax_operators(language));
+        return unknown;
+    }
+
+    SyntaxLanguageTables::SyntaxLanguageTables(std::vector<std::string> separators, std::vector<std::string> keywords, std::vector<std::string> operators)
+        : separators(std::move(separators)), keywords(std::move(keywords)), operators(std::move(operators))
+    {
+        keywordSet = KeywordSet(this->keywords);
+        operatorTrie = SeparatorTrie(this->operators);
+    }
+
+    SyntaxParser::SyntaxParser(std::string data, SyntaxParserLanguage language = SyntaxParserLanguage::C)
+    {
+        _data = std::move(data);
+        _language = language;
+        _tables = &SyntaxLanguageTables::get(language);
+        fill_table_members();
+        _includeSeparators = true;
+    }
+
+    void SyntaxParser::reset(std::string data, SyntaxParserLanguage language)
+    {
+        _data = std::move(data);
+        _language = language;
+        _tables = &SyntaxLanguageTables::get(language);
+        _ownTables.reset();
+        _tablesResolved = false;
+        fill_table_members();
+        _currentToken = SyntaxToken();
+        _operatorNode = -1;
+        _synaxTokens.clear();
+        _checkpoints.clear();
+        clear_brace_pairs();
+        _location = 0;
+        isInString = false;
+        isInChar = false;
+    }
+
+    std::vector<SyntaxToken> SyntaxParser::take_tokens()
+    {
+        std::vector<SyntaxToken> tokens = std::move(_synaxTokens);
+        _synaxTokens.clear();
+        _checkpoints.clear();
+        clear_brace_pairs();
+        return tokens;
+    }
+
+    const std::vector<SyntaxBracePair>& SyntaxParser::get_brace_pairs()
+    {
+        if(_bracePairsDirty)
         {
-            if(accept_token())
-                _synaxTokens.push_back(_currentToken);
+            clear_brace_pairs();
+            for(size_t i = 0 ; i < _synaxTokens.size() ; i++)
+                if(_synaxTokens[i].type == SyntaxTokenType::Braces)
+                    index_brace(_synaxTokens[i].value[0], i);
         }
+        return _bracePairs;
+    }
+
+    const SyntaxBracePair* SyntaxParser::find_brace_pair(size_t tokenIndex)
+    {
+        const std::vector<SyntaxBracePair>& pairs = get_brace_pairs();
+        auto it = std::lower_bound(pairs.begin(), pairs.end(), tokenIndex, [](const SyntaxBracePair& pair, size_t index){ return pair.open < index; });
+        return it != pairs.end() && it->open == tokenIndex ? &*it : nullptr;
+    }
+
+    void SyntaxParser::index_brace(char brace, size_t index)
+    {
+        if(_bracePairsDirty)
+            return;
+        if(brace == '{' || brace == '(' || brace == '[')
+        {
+            SyntaxBracePair pair;
+            pair.open = index;
+            pair.depth = _openBraces.size();
+            _openBraces.push_back(_bracePairs.size());
+            _bracePairs.push_back(pair);
+            return;
+        }
+        char open = brace == '}' ? '{' : brace == ')' ? '(' : '[';
+        if(!_openBraces.empty() && _synaxTokens[_bracePairs[_openBraces.back()].open].value[0] == open)
+        {
+            _bracePairs[_openBraces.back()].close = index;
+            _openBraces.pop_back();
+        }
+    }
+
+    void SyntaxParser::clear_brace_pairs()
+    {
+        _bracePairs.clear();
+        _openBraces.clear();
+        _bracePairsDirty = false;
+    }
+
+    bool SyntaxParser::accept_token()
+    {
+        // This is meant to be overridden if needed
+        return true;
+    }
+
+    void SyntaxParser::on_token(std::string& token, bool* discard, bool isSeparator, Token* tok)
+    {
+        // This is meant to be overridden if needed
+    }
+
+    void SyntaxParser::scan()
+    {
+        // The tokens of an earlier lex or scan are replaced, not added to
         _currentToken = SyntaxToken();
+        _operatorNode = -1;
+        _synaxTokens.clear();
+        _checkpoints.clear();
+        clear_brace_pairs();
+        isInString = false;
+        isInChar = false;
+        resolve_tables();
+        uint8_t classes[256];
+        if(!build_scan_classes(classes))
+        {
+            // lex(*this) would only call the functions of SyntaxParser, a pointer that does not own this
+            // goes through the virtual ones of the most derived parser
+            lex(std::shared_ptr<TokenParser>(std::shared_ptr<TokenParser>(), this));
+            return;
+        }
+        // Dense code has about a token every 4 bytes, reserving for it saves the reallocations
+        _synaxTokens.reserve(_data.size() / 4);
+        scan_from(classes, 0, {}, 0, 0);
     }
 
-    int SyntaxParser::process_token(std::string& token, bool* discard, bool isSeparator, Token* tok)
+    void SyntaxParser::edit(size_t offset, size_t removed, std::string_view text)
+    {
+        offset = std::min(offset, _data.size());
+        removed = std::min(removed, _data.size() - offset);
+        _data.replace(offset, removed, text);
+
+        resolve_tables();
+        uint8_t classes[256];
+        if(_checkpoints.empty() || !build_scan_classes(classes))
+        {
+            _synaxTokens.clear();
+            clear_brace_pairs();
+            _currentToken = SyntaxToken();
+            scan();
+            return;
+        }
+
+        // The last checkpoint at or before the edit, everything before it is not changed
+        size_t first = std::upper_bound(_checkpoints.begin(), _checkpoints.end(), offset,
+            [](size_t location, const SyntaxCheckpoint& checkpoint){ return location < checkpoint.location; }) - _checkpoints.begin() - 1;
+        SyntaxCheckpoint start = _checkpoints[first];
+        // Only the checkpoints after the removed text can be the same as before
+        std::vector<SyntaxCheckpoint> oldCheckpoints;
+        for(size_t i = first + 1 ; i < _checkpoints.size() ; i++)
+            if(_checkpoints[i].location >= offset + removed)
+                oldCheckpoints.push_back(_checkpoints[i]);
+        _checkpoints.resize(first);
+        long long delta = (long long)text.size() - (long long)removed;
+
+        // Scan the new text into an empty vector and splice it in place of the old tokens it replaces
+        // The token indices change so the brace pairs are built again when they are needed
+        _bracePairsDirty = true;
+        std::vector<SyntaxToken> tokens;
+        tokens.swap(_synaxTokens);
+        size_t checkpointsBegin = _checkpoints.size();
+        size_t resync = scan_from(classes, start.location, oldCheckpoints, delta, offset + text.size());
+        std::vector<SyntaxToken> scanned;
+        scanned.swap(_synaxTokens);
+        _synaxTokens.swap(tokens);
+        for(size_t i = checkpointsBegin ; i < _checkpoints.size() ; i++)
+            _checkpoints[i].tokenIndex += start.tokenIndex;
+
+        size_t replacedEnd = resync < oldCheckpoints.size() ? oldCheckpoints[resync].tokenIndex : _synaxTokens.size();
+        size_t replaced = replacedEnd - start.tokenIndex;
+        size_t common = std::min(replaced, scanned.size());
+        std::move(scanned.begin(), scanned.begin() + common, _synaxTokens.begin() + start.tokenIndex);
+        if(scanned.size() > replaced)
+            _synaxTokens.insert(_synaxTokens.begin() + replacedEnd, std::make_move_iterator(scanned.begin() + common), std::make_move_iterator(scanned.end()));
+        else
+            _synaxTokens.erase(_synaxTokens.begin() + start.tokenIndex + common, _synaxTokens.begin() + replacedEnd);
+
+        // The tokens and checkpoints after the resync point are the old ones moved by the size change
+        if(resync < oldCheckpoints.size())
+        {
+            long long indexDelta = (long long)scanned.size() - (long long)replaced;
+            if(delta != 0)
+                for(size_t i = start.tokenIndex + scanned.size() ; i < _synaxTokens.size() ; i++)
+                    _synaxTokens[i].location += (int)delta;
+            for(size_t i = resync ; i < oldCheckpoints.size() ; i++)
+                _checkpoints.push_back({oldCheckpoints[i].location + delta, oldCheckpoints[i].tokenIndex + indexDelta});
+        }
+    }
+
+    bool SyntaxParser::build_scan_classes(uint8_t* classes)
     {
-        if(isSeparator)
+        const std::vector<std::string>& separators = _tables->separators;
+        std::fill(classes, classes + 256, (uint8_t)ScanWord);
+        // Same order as process_token so a byte gets the class its piece would get there
+        for(const std::string& separator : separators)
         {
-            if(token == "." && (!isInString && !isInChar))
+            if(separator.size() != 1)
+                return false;
+            unsigned char c = separator[0];
+            if(c == '.')
+                classes[c] = ScanDot;
+            else if(_tables->operatorTrie.match(separator.data(), 1) == 1)
+                classes[c] = ScanOperator;
+            else if(c == '{' || c == '}' || c == '(' || c == ')' || c == '[' || c == ']')
+                classes[c] = ScanBrace;
+            else if(c == '"')
+                classes[c] = ScanQuote;
+            else if(c == '\'')
+                classes[c] = ScanApostrophe;
+            else
+                classes[c] = ScanBreak;
+        }
+        return true;
+    }
+
+    size_t SyntaxParser::scan_from(const uint8_t* classes, size_t location, const std::vector<SyntaxCheckpoint>& resync, long long delta, size_t resyncAfter)
+    {
+#ifdef LEXPP_STATS
+        LexStatsScope statsScope(_stats ? _stats : current_lex_stats());
+#endif
+        LEXPP_STAT_TIMER(lexSeconds);
+        const char* begin = _data.data();
+        const char* end = begin + _data.size();
+        const char* it = begin + location;
+        // Only the quote and the backslash matter inside a literal
+        const CharClass stringStops("\"\\");
+        const CharClass charStops("\'\\");
+        size_t nextResync = 0;
+        size_t nextCheckpoint = location;
+        _currentToken = SyntaxToken();
+        while(it < end)
+        {
+            _location = (int)(it - begin);
+            if(_currentToken.type == SyntaxTokenType::None)
             {
-                if(_currentToken.type == Number)
-                    _currentToken.value += token;
-                else
+                // Nothing is pending so the rest only depends on the bytes from here
+                size_t here = (size_t)_location;
+                while(nextResync < resync.size() && (long long)resync[nextResync].location + delta < (long long)here)
+                    nextResync++;
+                if(here >= resyncAfter && nextResync < resync.size() && (long long)resync[nextResync].location + delta == (long long)here)
                 {
-                    push_token();
-                    _currentToken.type = SyntaxTokenType::Operator;
-                    _currentToken.value = ".";
-                    push_token();
+                    LEXPP_STAT(bytesScanned, here - location);
+                    return nextResync;
+                }
+                if(here >= nextCheckpoint)
+                {
+                    _checkpoints.push_back({here, _synaxTokens.size()});
+                    nextCheckpoint = here + _checkpointInterval;
                 }
             }
-            else if(std::find(_operators.begin(), _operators.end(), token) != _operators.end() && (!isInString && !isInChar))
+            switch(classes[(unsigned char)*it])
             {
-                if(_currentToken.type == SyntaxTokenType::Operator)
+                case ScanWord:
                 {
-                    std::string cVal = _currentToken.value + token;
-                    if(std::find(_operators.begin(), _operators.end(), cVal) != _operators.end())
+                    const char* wordEnd = it + 1;
+                    while(wordEnd < end && classes[(unsigned char)*wordEnd] == ScanWord)
+                        wordEnd++;
+                    std::string_view word(it, wordEnd - it);
+                    // The digits after the dot of a number
+                    if(_currentToken.type == SyntaxTokenType::Number && _currentToken.value.back() == '.' && is_number(word))
+                        _currentToken.value += word;
+                    else
                     {
-                        _currentToken.value = cVal;
-                        _currentToken.type = SyntaxTokenType::Operator;
                         push_token();
+                        if(is_number(word))
+                            _currentToken.type = SyntaxTokenType::Number;
+                        else if(_tables->keywordSet.contains(word))
+                            _currentToken.type = SyntaxTokenType::Keyword;
+                        else
+                            _currentToken.type = SyntaxTokenType::Identifier;
+                        _currentToken.value = word;
+                        _currentToken.location = _location;
                     }
+                    it = wordEnd;
+                    break;
+                }
+                case ScanDot:
+                    if(_currentToken.type == SyntaxTokenType::Number)
+                        _currentToken.value += '.';
                     else
-                    {                        
-                        push_token();                    
+                    {
+                        push_token();
                         _currentToken.type = SyntaxTokenType::Operator;
-                        _currentToken.value = token;
+                        _currentToken.value = ".";
+                        _currentToken.location = _location;
                         push_token();
+                    }
+                    it++;
+                    break;
+                case ScanOperator:
+                    push_operator_char(*it, _location);
+                    it++;
+                    break;
+                case ScanBrace:
+                    push_token();
+                    _currentToken.type = SyntaxTokenType::Braces;
+                    _currentToken.value = *it;
+                    _currentToken.location = _location;
+                    push_token();
+                    it++;
+                    break;
+                case ScanQuote:
+                    it = scan_literal(it, end, stringStops);
+                    break;
+                case ScanApostrophe:
+                    it = scan_literal(it, end, charStops);
+                    break;
+                default:
+                    push_token();
+                    it++;
+                    break;
+            }
+        }
+        push_token();
+        LEXPP_STAT(bytesScanned, _data.size() - location);
+        return resync.size();
+    }
 
-                    }                    
-                }
+    const char* SyntaxParser::scan_literal(const char* begin, const char* end, const CharClass& stops)
+    {
+        push_token();
+        char quote = *begin;
+        const char* contentBegin = begin + 1;
+        const char* it = contentBegin;
+        while(true)
+        {
+            it = stops.find(it, end);
+            if(it == end || *it == quote)
+                break;
+            // A backslash escapes the byte after it
+            it = std::min(it + 2, end);
+        }
+        if(it > contentBegin)
+        {
+            _currentToken.type = quote == '"' ? SyntaxTokenType::String : SyntaxTokenType::Character;
+            _currentToken.value.assign(contentBegin, it);
+            _currentToken.location = (int)(contentBegin - _data.data());
+            push_token();
+        }
+        return it == end ? end : it + 1;
+    }
+
+    void SyntaxParser::resolve_tables()
+    {
+        if(_tablesResolved)
+            return;
+        _tablesResolved = true;
+        const SyntaxLanguageTables& shared = SyntaxLanguageTables::get(_language);
+        std::vector<std::string> separators = get_separators();
+        std::vector<std::string> keywords = get_keywords();
+        std::vector<std::string> operators = get_operators();
+        if(separators == shared.separators && keywords == shared.keywords && operators == shared.operators)
+        {
+            _tables = &shared;
+            return;
+        }
+        _ownTables = std::make_shared<const SyntaxLanguageTables>(std::move(separators), std::move(keywords), std::move(operators));
+        _tables = _ownTables.get();
+        // The members then hold what is lexed with, also when it came from an overridden getter
+        fill_table_members();
+    }
+
+    void SyntaxParser::fill_table_members()
+    {
+        _separators = _tables->separators;
+        _keywords = _tables->keywords;
+        _operators = _tables->operators;
+    }
+
+    std::vector<std::string> SyntaxParser::get_separators()
+    {
+        return _separators;
+    }
+
+    std::vector<std::string> SyntaxParser::get_operators()
+    {
+        return _operators;
+    }
+
+    std::vector<std::string> SyntaxParser::get_keywords()
+    {
+        return _keywords;
+    }
+
+    void SyntaxParser::push_operator_char(char c, int location)
+    {
+        if(_currentToken.type == SyntaxTokenType::Operator)
+        {
+            int next = _operatorNode >= 0 ? _tables->operatorTrie.step(_operatorNode, c) : -1;
+            if(next >= 0)
+            {
+                _currentToken.value += c;
+                _operatorNode = next;
+                return;
+            }
+            // The text can not grow into a longer operator, give out the longest operator it starts with
+            // and go over the rest again since it may join with c
+            std::string text = _currentToken.value;
+            int start = _currentToken.location;
+            size_t length = std::max<size_t>(_tables->operatorTrie.match(text.data(), text.size()), 1);
+            _currentToken.value.resize(length);
+            push_token();
+            for(size_t i = length ; i < text.size() ; i++)
+                push_operator_char(text[i], start + (int)i);
+            push_operator_char(c, location);
+            return;
+        }
+        push_token();
+        _currentToken.type = SyntaxTokenType::Operator;
+        _currentToken.value = c;
+        _currentToken.location = location;
+        _operatorNode = _tables->operatorTrie.step(-1, c);
+    }
+
+    void SyntaxParser::push_token()
+    {
+        // Without more bytes an unfinished operator is given out as the longest operators it is made of
+        if(_currentToken.type == SyntaxTokenType::Operator && _currentToken.value.size() > 1 && !_tables->operatorTrie.is_terminal(_operatorNode))
+        {
+            std::string text = _currentToken.value;
+            int start = _currentToken.location;
+            for(size_t i = 0 ; i < text.size() ; )
+            {
+                size_t length = std::max<size_t>(_tables->operatorTrie.match(text.data() + i, text.size() - i), 1);
+                _currentToken.type = SyntaxTokenType::Operator;
+                _currentToken.value = text.substr(i, length);
+                _currentToken.location = start + (int)i;
+                _operatorNode = -1;
+                if(accept_token())
+                    _synaxTokens.push_back(_currentToken);
+                i += length;
+            }
+            _currentToken = SyntaxToken();
+            return;
+        }
+        if(_currentToken.type != SyntaxTokenType::None && _currentToken.value.size() > 0)
+        {
+            // A token without a location was started by the current piece
+            if(_currentToken.location < 0)
+                _currentToken.location = _location;
+            if(accept_token())
+            {
+                if(_currentToken.type == SyntaxTokenType::Braces)
+                    index_brace(_currentToken.value[0], _synaxTokens.size());
+                _synaxTokens.push_back(std::move(_currentToken));
+            }
+        }
+        _currentToken.value.clear();
+        _currentToken.type = SyntaxTokenType::None;
+        _currentToken.userdata = nullptr;
+        _currentToken.location = -1;
+    }
+
+    int SyntaxParser::process_token(std::string& token, bool* discard, bool isSeparator, Token* tok)
+    {
+        if(!_tablesResolved)
+            resolve_tables();
+        _location = tok->location;
+        if(isInString || isInChar)
+        {
+            // Everything up to the closing quote is part of the literal
+            const char* quote = isInString ? "\"" : "\'";
+            if(isSeparator && token == quote && !ends_with_escape(_currentToken.value))
+            {
+                push_token();
+                isInString = false;
+                isInChar = false;
+            }
+            else
+            {
+                _currentToken.type = isInString ? SyntaxTokenType::String : SyntaxTokenType::Character;
+                _currentToken.value += token;
+            }
+        }
+        else if(isSeparator)
+        {
+            if(token == ".")
+            {
+                if(_currentToken.type == Number)
+                    _currentToken.value += token;
                 else
                 {
                     push_token();
                     _currentToken.type = SyntaxTokenType::Operator;
-                    _currentToken.value = token;
+                    _currentToken.value = ".";
+                    push_token();
                 }
             }
-            else if( (token == "}" || token == "{" || token == "(" || token == ")" || token == "[" || token == "]") && (!isInString && !isInChar))
+            else if(_tables->operatorTrie.match(token.data(), token.size()) == token.size())
+            {
+                // Operators can be split over many pieces so they are built a byte at a time
+                for(size_t i = 0 ; i < token.size() ; i++)
+                    push_operator_char(token[i], _location + (int)i);
+            }
+            else if(token == "}" || token == "{" || token == "(" || token == ")" || token == "[" || token == "]")
             {
                 push_token();
                 _currentToken.type = SyntaxTokenType::Braces;
@@ -334,69 +970,96 @@ namespace lexpp
             }
             else if(token == "\"")
             {
-                if(isInString)
-                {
-                    _currentToken.type = SyntaxTokenType::String;
-                    if(_currentToken.value[_currentToken.value.size() - 1 ] != '\\')
-                        push_token();
-                    isInString = false;
-                }
-                else
-                {
-                    push_token();
-                    isInString = true;
-                }
+                push_token();
+                isInString = true;
             }
             else if(token == "\'")
             {
-                if(isInChar)
-                {
-                    _currentToken.type = SyntaxTokenType::Character;
-                    if(_currentToken.value[_currentToken.value.size() - 1 ] != '\\')
-                        push_token();
-                    isInChar = false;
-                }
-                else
-                {
-                    push_token();
-                    isInChar = false;
-                }
+                push_token();
+                isInChar = true;
             }
-            else if(token == " " || token == "\n" || token == "\t"){
-                if(!isInString && !isInChar)
-                    push_token();
+            else
+            {
+                // Whitespace and the other separators only end the current token
+                push_token();
             }
-            else if(isInChar || isInString)
-                _currentToken.value += token;
         }
         else
         {
-            if(isInChar)
-                _currentToken.type = SyntaxTokenType::Character;
-            else if(isInString)
-                _currentToken.type = SyntaxTokenType::String;
-            else 
+            // The digits after the dot of a number
+            if(_currentToken.type == SyntaxTokenType::Number && _currentToken.value.back() == '.' && is_number(token))
+                _currentToken.value += token;
+            else
             {
                 push_token();
                 if(is_number(token))
                     _currentToken.type = SyntaxTokenType::Number;
-                else if(std::find(_keywords.begin(), _keywords.end(), token) != _keywords.end())
+                else if(_tables->keywordSet.contains(token))
                     _currentToken.type = SyntaxTokenType::Keyword;
                 else
                     _currentToken.type = SyntaxTokenType::Identifier;
+                _currentToken.value = token;
             }
-            _currentToken.value += token;
         }
+        if(_currentToken.location < 0 && _currentToken.value.size() > 0)
+            _currentToken.location = _location;
         *discard = true;
         on_token(token, discard, isSeparator, tok);
         return 0;
     }
 
-    bool SyntaxParser::is_number(std::string& s)
+    void SyntaxParser::on_end()
+    {
+        push_token();
+        isInString = false;
+        isInChar = false;
+    }
+
+    bool SyntaxParser::ends_with_escape(std::string_view value)
+    {
+        // An odd number of backslashes escapes what comes next
+        size_t count = 0;
+        while(count < value.size() && value[value.size() - 1 - count] == '\\')
+            count++;
+        return count % 2 == 1;
+    }
+
+    bool SyntaxParser::is_number(std::string_view s)
     {
         return !s.empty() && std::find_if(s.begin(), s.end(), [](unsigned char c) { return (!std::isdigit(c) && c != '.' && c!='f'); }) == s.end();
     }
 
+    std::unique_ptr<SyntaxParser> SyntaxParserPool::acquire(std::string data, SyntaxParserLanguage language)
+    {
+        std::unique_ptr<SyntaxParser> parser;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if(!_parsers.empty())
+            {
+                parser = std::move(_parsers.back());
+                _parsers.pop_back();
+            }
+        }
+        if(!parser)
+            return std::make_unique<SyntaxParser>(std::move(data), language);
+        parser->reset(std::move(data), language);
+        return parser;
+    }
+
+    void SyntaxParserPool::release(std::unique_ptr<SyntaxParser> parser)
+    {
+        if(!parser)
+            return;
+        std::lock_guard<std::mutex> lock(_mutex);
+        _parsers.push_back(std::move(parser));
+    }
+
+    size_t SyntaxParserPool::size()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _parsers.size();
+    }
+
 #endif
     
 }
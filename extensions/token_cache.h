@@ -0,0 +1,398 @@
+/*
+MIT License
+
+Copyright (c) 2021 Jaysmito Mukherjee (jaysmito101@gmail.com)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+ */
+
+#ifndef LEXPP_TOKEN_CACHE_H
+#define LEXPP_TOKEN_CACHE_H
+
+#include "../lexpp.h"
+#include "mapped_file.h"
+#include "syntax_parser.h"
+#include <unordered_map>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <cstring>
+#include <cstdio>
+
+namespace lexpp
+{
+
+    // What a cached token stream was lexed from, a cache file is only used for the same key
+    struct TokenCacheKey
+    {
+        // Set by the parser that lexed the input, see syntax_parser_identity
+        uint64_t identity = 0;
+        uint64_t contentHash = 0;
+        uint64_t contentSize = 0;
+    };
+
+    // A token cache file is this header, tokenCount records and then the string table the records point into.
+    // Every field is in the byte order of the machine that wrote it, a file from another byte order fails the version check
+    struct TokenCacheHeader
+    {
+        char magic[4];
+        uint32_t version;
+        TokenCacheKey key;
+        uint64_t tokenCount;
+        uint64_t stringTableSize;
+    };
+
+    struct TokenCacheRecord
+    {
+        uint32_t type;
+        uint32_t location;
+        // Value of the token in the string table, equal values are stored once
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    // The file format depends on these sizes, there is no padding in either struct
+    static_assert(sizeof(TokenCacheHeader) == 48, "TokenCacheHeader has to be 48 bytes");
+    static_assert(sizeof(TokenCacheRecord) == 16, "TokenCacheRecord has to be 16 bytes");
+
+    // Fast 64 bit hash of data for cache keys, not meant to be hard to collide on purpose
+    uint64_t hash_bytes(std::string_view data, uint64_t seed = 0);
+
+    // Identity of SyntaxParser for a language, it changes with the tables of the language and the lexing rules
+    uint64_t syntax_parser_identity(SyntaxParserLanguage language);
+
+    // Identity of any other parser from a name that has to change whenever its tokens would
+    uint64_t token_parser_identity(std::string_view name);
+
+    // Key of data lexed by the parser of identity, it holds the identity, hash_bytes of data and the size of data
+    TokenCacheKey token_cache_key(uint64_t identity, std::string_view data);
+
+    // Writes the tokens in the token cache format, returns an empty string if a value or location does not fit in 32 bits
+    // TokenType needs value, type and location like SyntaxToken and Token
+    template<typename TokenType>
+    std::string encode_token_cache(const std::vector<TokenType>& tokens, const TokenCacheKey& key);
+
+    // Reads the tokens of a token cache in place, nothing is copied so the bytes have to outlive it
+    class TokenCacheView
+    {
+        public:
+        TokenCacheView() {}
+
+        // Returns false if data is not a whole token cache of this version
+        bool open(std::string_view data);
+        bool is_open() const { return _records != nullptr; }
+
+        const TokenCacheKey& key() const { return _header.key; }
+        size_t size() const { return (size_t)_header.tokenCount; }
+
+        TokenCacheRecord record(size_t index) const;
+        int type(size_t index) const { return (int)record(index).type; }
+        int location(size_t index) const { return (int)record(index).location; }
+        std::string_view value(size_t index) const;
+
+        // Copies the tokens out, TokenType needs value, type and location like SyntaxToken and Token
+        template<typename TokenType>
+        std::vector<TokenType> to_tokens() const;
+
+        private:
+        TokenCacheHeader _header = {};
+        const char* _records = nullptr;
+        const char* _strings = nullptr;
+    };
+
+    // A token cache file mapped in memory
+    struct CachedTokens
+    {
+        MappedFile file;
+        TokenCacheView view;
+    };
+
+    // Token caches in a directory, one file per key. Safe to share between processes, a file is written
+    // next to its final name and renamed so a reader never sees half of it
+    class TokenCache
+    {
+        public:
+        TokenCache(std::string directory);
+
+        // Maps the cache file of key, returns false if there is none or it is not valid
+        bool load(const TokenCacheKey& key, CachedTokens& result) const;
+        // Returns false if the file could not be written
+        template<typename TokenType>
+        bool store(const TokenCacheKey& key, const std::vector<TokenType>& tokens) const;
+
+        // The tokens of SyntaxParser::scan for data from the cache, lexed and stored on a miss
+        std::vector<SyntaxToken> lex(std::string data, SyntaxParserLanguage language) const;
+        // The tokens of lex(parser) from the cache, lexed and stored on a miss. identity comes from token_parser_identity.
+        // The key is made from parser->data() without a copy, so a parser whose get_data gives other text needs an identity
+        // that covers it. On a hit the parser is not run at all : process_token, on_token and on_end are not called
+        // and nothing the parser keeps about its tokens is filled
+        std::vector<Token> lex(std::shared_ptr<TokenParser> parser, uint64_t identity) const;
+
+        std::string path(const TokenCacheKey& key) const;
+
+        private:
+        bool write(const TokenCacheKey& key, const std::string& bytes) const;
+
+        std::string _directory;
+    };
+
+    // Template implementations
+
+    template<typename TokenType>
+    std::string encode_token_cache(const std::vector<TokenType>& tokens, const TokenCacheKey& key)
+    {
+        std::string strings;
+        std::unordered_map<std::string_view, uint32_t> stringOffsets;
+        std::vector<TokenCacheRecord> records(tokens.size());
+        for(size_t i = 0 ; i < tokens.size() ; i++){
+            std::string_view value = tokens[i].value;
+            if(value.size() > UINT32_MAX || (int64_t)tokens[i].location > (int64_t)UINT32_MAX)
+                return "";
+            auto it = stringOffsets.find(value);
+            if(it == stringOffsets.end()){
+                if(strings.size() + value.size() > UINT32_MAX)
+                    return "";
+                it = stringOffsets.emplace(value, (uint32_t)strings.size()).first;
+                strings += value;
+            }
+            records[i].type = (uint32_t)tokens[i].type;
+            records[i].location = (uint32_t)tokens[i].location;
+            records[i].offset = it->second;
+            records[i].length = (uint32_t)value.size();
+        }
+
+        TokenCacheHeader header = {};
+        std::memcpy(header.magic, "LXTC", 4);
+        header.version = 1;
+        header.key = key;
+        header.tokenCount = tokens.size();
+        header.stringTableSize = strings.size();
+        std::string bytes;
+        bytes.reserve(sizeof(header) + records.size() * sizeof(TokenCacheRecord) + strings.size());
+        bytes.append((const char*)&header, sizeof(header));
+        bytes.append((const char*)records.data(), records.size() * sizeof(TokenCacheRecord));
+        bytes += strings;
+        return bytes;
+    }
+
+    template<typename TokenType>
+    std::vector<TokenType> TokenCacheView::to_tokens() const
+    {
+        std::vector<TokenType> tokens(size());
+        for(size_t i = 0 ; i < tokens.size() ; i++){
+            TokenCacheRecord entry = record(i);
+            tokens[i].value = std::string(_strings + entry.offset, entry.length);
+            tokens[i].type = static_cast<decltype(tokens[i].type)>((int)entry.type);
+            tokens[i].location = (int)entry.location;
+        }
+        return tokens;
+    }
+
+    template<typename TokenType>
+    bool TokenCache::store(const TokenCacheKey& key, const std::vector<TokenType>& tokens) const
+    {
+        std::string bytes = encode_token_cache(tokens, key);
+        return !bytes.empty() && write(key, bytes);
+    }
+
+#ifdef LEXPP_IMPLEMENTATION
+
+    // Function Implementations
+
+    uint64_t hash_bytes(std::string_view data, uint64_t seed)
+    {
+        // Eight bytes at a time with a multiply and rotate per word, then the tail and the size
+        const uint64_t prime = 0x9e3779b97f4a7c15ull;
+        uint64_t h = seed ^ (data.size() * prime);
+        size_t i = 0;
+        for( ; i + 8 <= data.size() ; i += 8){
+            uint64_t word;
+            std::memcpy(&word, data.data() + i, 8);
+            h = (h ^ (word * 0xff51afd7ed558ccdull)) * prime;
+            h = (h << 31) | (h >> 33);
+        }
+        uint64_t tail = 0;
+        // data.data() may be null for an empty view
+        if(i < data.size())
+            std::memcpy(&tail, data.data() + i, data.size() - i);
+        h = (h ^ (tail * 0xff51afd7ed558ccdull)) * prime;
+        h ^= h >> 32;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 29;
+        return h;
+    }
+
+    uint64_t syntax_parser_identity(SyntaxParserLanguage language)
+    {
+        auto identity = [](SyntaxParserLanguage language){
+            // Bump when a change to SyntaxParser gives other tokens for the same tables
+            const char* rulesVersion = "SyntaxParser 1";
+            const SyntaxLanguageTables& tables = SyntaxLanguageTables::get(language);
+            uint64_t h = hash_bytes(rulesVersion, (uint64_t)language);
+            for(const std::vector<std::string>* list : {&tables.separators, &tables.keywords, &tables.operators}){
+                for(const std::string& entry : *list)
+                    h = hash_bytes(entry, h);
+                h = hash_bytes("|", h);
+            }
+            return h;
+        };
+        static const std::vector<uint64_t> identities = [&identity]{
+            std::vector<uint64_t> result(SyntaxParserLanguage::Scala + 1);
+            for(size_t i = 0 ; i < result.size() ; i++)
+                result[i] = identity((SyntaxParserLanguage)i);
+            return result;
+        }();
+        // A language out of the enum is lexed with the tables SyntaxLanguageTables::get gives it, so is its identity
+        if((size_t)language >= identities.size())
+            return identity(language);
+        return identities[language];
+    }
+
+    uint64_t token_parser_identity(std::string_view name)
+    {
+        return hash_bytes(name, hash_bytes("TokenParser"));
+    }
+
+    TokenCacheKey token_cache_key(uint64_t identity, std::string_view data)
+    {
+        TokenCacheKey key;
+        key.identity = identity;
+        key.contentHash = hash_bytes(data);
+        key.contentSize = data.size();
+        return key;
+    }
+
+    // Class Implementations
+
+    bool TokenCacheView::open(std::string_view data)
+    {
+        _records = nullptr;
+        _strings = nullptr;
+        if(data.size() < sizeof(TokenCacheHeader))
+            return false;
+        std::memcpy(&_header, data.data(), sizeof(TokenCacheHeader));
+        if(std::memcmp(_header.magic, "LXTC", 4) != 0 || _header.version != 1)
+            return false;
+        uint64_t recordBytes = _header.tokenCount * sizeof(TokenCacheRecord);
+        if(_header.tokenCount > data.size() / sizeof(TokenCacheRecord) || sizeof(TokenCacheHeader) + recordBytes + _header.stringTableSize != data.size())
+            return false;
+        _records = data.data() + sizeof(TokenCacheHeader);
+        _strings = _records + recordBytes;
+        // Every value has to be inside the string table so value() needs no checks
+        for(size_t i = 0 ; i < size() ; i++){
+            TokenCacheRecord entry = record(i);
+            if((uint64_t)entry.offset + entry.length > _header.stringTableSize){
+                _records = nullptr;
+                _strings = nullptr;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    TokenCacheRecord TokenCacheView::record(size_t index) const
+    {
+        // The records may not be aligned in a buffer that is not a mapping
+        TokenCacheRecord entry;
+        std::memcpy(&entry, _records + index * sizeof(TokenCacheRecord), sizeof(TokenCacheRecord));
+        return entry;
+    }
+
+    std::string_view TokenCacheView::value(size_t index) const
+    {
+        TokenCacheRecord entry = record(index);
+        return std::string_view(_strings + entry.offset, entry.length);
+    }
+
+    TokenCache::TokenCache(std::string directory)
+    :_directory(std::move(directory))
+    {
+        std::error_code error;
+        std::filesystem::create_directories(_directory, error);
+    }
+
+    std::string TokenCache::path(const TokenCacheKey& key) const
+    {
+        char name[64];
+        std::snprintf(name, sizeof(name), "%016llx-%016llx.ltc", (unsigned long long)key.identity, (unsigned long long)key.contentHash);
+        return (std::filesystem::path(_directory) / name).string();
+    }
+
+    bool TokenCache::load(const TokenCacheKey& key, CachedTokens& result) const
+    {
+        if(!result.file.open(path(key)) || !result.view.open(result.file.data()))
+            return false;
+        const TokenCacheKey& stored = result.view.key();
+        return stored.identity == key.identity && stored.contentHash == key.contentHash && stored.contentSize == key.contentSize;
+    }
+
+    bool TokenCache::write(const TokenCacheKey& key, const std::string& bytes) const
+    {
+        // A name of its own per writer so two processes storing the same key do not write into one file
+        std::string finalPath = path(key);
+        std::string temporaryPath = finalPath + "." + std::to_string(std::random_device()()) + ".tmp";
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if(!file)
+            return false;
+        file.write(bytes.data(), bytes.size());
+        // close flushes, a failed flush means the file is not whole
+        file.close();
+        std::error_code removeError;
+        if(file.fail()){
+            std::filesystem::remove(temporaryPath, removeError);
+            return false;
+        }
+        std::error_code error;
+        std::filesystem::rename(temporaryPath, finalPath, error);
+        if(error){
+            std::filesystem::remove(temporaryPath, removeError);
+            return false;
+        }
+        return true;
+    }
+
+    std::vector<SyntaxToken> TokenCache::lex(std::string data, SyntaxParserLanguage language) const
+    {
+        TokenCacheKey key = token_cache_key(syntax_parser_identity(language), data);
+        CachedTokens cached;
+        if(load(key, cached))
+            return cached.view.to_tokens<SyntaxToken>();
+        SyntaxParser parser(std::move(data), language);
+        parser.scan();
+        std::vector<SyntaxToken> tokens = parser.take_tokens();
+        store(key, tokens);
+        return tokens;
+    }
+
+    std::vector<Token> TokenCache::lex(std::shared_ptr<TokenParser> parser, uint64_t identity) const
+    {
+        TokenCacheKey key = token_cache_key(identity, parser->data());
+        CachedTokens cached;
+        if(load(key, cached))
+            return cached.view.to_tokens<Token>();
+        std::vector<Token> tokens = lexpp::lex(parser);
+        store(key, tokens);
+        return tokens;
+    }
+
+#endif
+
+}
+
+#endif
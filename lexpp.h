@@ -31,6 +31,37 @@ SOFTWARE.
 #include <algorithm>
 #include <functional>
 #include <memory>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+#include <limits>
+#include <array>
+#include <iterator>
+#include <type_traits>
+#include <memory_resource>
+
+// SIMD scanning is used on x86 unless LEXPP_NO_SIMD is defined, the kernel is picked at runtime
+#if !defined(LEXPP_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#define LEXPP_X86_SIMD
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define LEXPP_TARGET(x)
+#else
+#define LEXPP_TARGET(x) __attribute__((target(x)))
+#endif
+#endif
+
+// LexStats are only filled if LEXPP_STATS is defined, otherwise every counter compiles to nothing
+#ifdef LEXPP_STATS
+#include <chrono>
+#define LEXPP_STAT(field, value) do{ if(::lexpp::LexStats* lexStats = ::lexpp::current_lex_stats()) lexStats->field += (value); }while(0)
+#define LEXPP_STAT_TIMER(field) ::lexpp::LexStatsTimer lexStatsTimer_##field(&::lexpp::LexStats::field)
+#else
+#define LEXPP_STAT(field, value) ((void)0)
+#define LEXPP_STAT_TIMER(field) ((void)0)
+#endif
 
 namespace lexpp{
 
@@ -42,6 +73,74 @@ namespace lexpp{
         int location;
     };
 
+    // Same as Token but the value is a view into the lexed buffer and location is its byte offset
+    struct TokenView
+    {
+        std::string_view value;
+        int type;
+        void* userdata;
+        size_t location;
+    };
+
+    // What the lexing functions did, filled only when LEXPP_STATS is defined
+    // Attach it to the calls of a thread with LexStatsScope or to a TokenParser with set_stats
+    struct LexStats
+    {
+        size_t bytesScanned = 0;
+        size_t tokensEmitted = 0;
+        // Tokens that process_token or a token function discarded
+        size_t tokensDiscarded = 0;
+        // Positions checked against the separators
+        size_t separatorMatches = 0;
+        // Separator candidates refused by accept_separator
+        size_t separatorRejections = 0;
+        // Allocations made to store the returned tokens
+        size_t allocations = 0;
+        size_t bytesAllocated = 0;
+        // Wall time building separator tables, lexing and inside process_token (which is part of lexSeconds)
+        double setupSeconds = 0;
+        double lexSeconds = 0;
+        double processSeconds = 0;
+
+        void reset() { *this = LexStats(); }
+        LexStats& operator+=(const LexStats& other);
+    };
+
+    // Sends the stats of every lexing call on this thread to stats until it is destroyed
+    // Calls on other threads (like the workers of lex_parallel) are not counted
+    class LexStatsScope
+    {
+        public:
+        LexStatsScope(LexStats* stats);
+        ~LexStatsScope();
+        LexStatsScope(const LexStatsScope&) = delete;
+        LexStatsScope& operator=(const LexStatsScope&) = delete;
+
+        private:
+        LexStats* _previous;
+    };
+
+    // The stats attached to this thread or nullptr
+    LexStats* current_lex_stats();
+
+#ifdef LEXPP_STATS
+    // Adds the time until it is destroyed to a field of the current stats
+    class LexStatsTimer
+    {
+        public:
+        LexStatsTimer(double LexStats::* field) : _field(field), _begin(std::chrono::steady_clock::now()) {}
+        ~LexStatsTimer()
+        {
+            if(LexStats* stats = current_lex_stats())
+                stats->*_field += std::chrono::duration<double>(std::chrono::steady_clock::now() - _begin).count();
+        }
+
+        private:
+        double LexStats::* _field;
+        std::chrono::steady_clock::time_point _begin;
+    };
+#endif
+
 
     class TokenParser
     {
@@ -51,16 +150,116 @@ namespace lexpp{
         TokenParser(std::string data, std::vector<std::string> separators = {" ", "\n"}, bool includeSeparators = false);
         virtual std::vector<std::string> get_separators();
         virtual std::string get_data();
+        // The data without a copy, lex(Parser&) uses it when get_data is not overridden
+        const std::string& data() const { return _data; }
         bool include_separators();
 
         virtual int process_token(std::string& token, bool* discard, bool isSeparator, Token* tok) = 0;
         virtual void on_end();
         virtual bool accept_separator(int location, std::string separator);
 
+        // The stats lexing this parser is counted in (with LEXPP_STATS), nullptr uses the ones of the thread
+        void set_stats(LexStats* stats) { _stats = stats; }
+        LexStats* stats() const { return _stats; }
+
         protected:
         std::string _data;
         std::vector<std::string> _separators;
         bool _includeSeparators;
+        LexStats* _stats = nullptr;
+    };
+
+    // Set of single byte separators stored as a 256 bit map
+    class CharClass
+    {
+        public:
+        CharClass();
+        CharClass(std::string_view chars);
+        void add(char c);
+
+        bool contains(char c) const { return (_bits[(unsigned char)c >> 6] >> ((unsigned char)c & 63)) & 1; }
+        // Position of the first byte in [begin, end) that is in the set or end if there is none
+        const char* find(const char* begin, const char* end) const;
+
+        private:
+        void build_nibble_tables();
+
+        uint64_t _bits[4];
+        // Bucket masks for the low and high nibble of a byte used by the SIMD kernels
+        // A byte may be in the set only if _lowNibble[b & 15] & _highNibble[b >> 4] is not 0
+        alignas(16) uint8_t _lowNibble[16];
+        alignas(16) uint8_t _highNibble[16];
+
+        friend struct CharClassKernels;
+    };
+
+    // Prefix tree of all the separators, used to find the longest separator starting at a position
+    class SeparatorTrie
+    {
+        public:
+        SeparatorTrie();
+        SeparatorTrie(const std::vector<std::string>& separators);
+        void insert(std::string_view separator);
+
+        // Length of the longest separator data starts with or 0 if there is none
+        size_t match(const char* data, size_t size) const;
+        // Same as match but each candidate length is offered to accept (longest first) until one is accepted
+        template<typename Accept>
+        size_t match(const char* data, size_t size, Accept accept) const;
+
+        bool can_start(char c) const { return _root[(unsigned char)c] >= 0; }
+        // Walks the trie one byte at a time, node -1 is the root and -1 is returned if no separator continues with c
+        int step(int node, char c) const { return node < 0 ? _root[(unsigned char)c] : child(node, c); }
+        // True if the bytes walked to node are a whole separator
+        bool is_terminal(int node) const { return node >= 0 && _nodes[node].terminal; }
+        // The set of bytes that some separator starts with
+        const CharClass& first_bytes() const { return _firstBytes; }
+        size_t max_length() const { return _maxLength; }
+        bool empty() const { return _nodes.empty(); }
+
+        private:
+        int child(int node, char c) const;
+
+        struct Node
+        {
+            std::vector<std::pair<char, int>> children;
+            bool terminal = false;
+        };
+        // Index of the node for every first byte, -1 if no separator starts with it
+        int _root[256];
+        std::vector<Node> _nodes;
+        CharClass _firstBytes;
+        size_t _maxLength;
+    };
+
+    // Lookup table with true for every byte in Chars
+    template<char... Chars>
+    constexpr std::array<bool, 256> make_char_table()
+    {
+        std::array<bool, 256> table = {};
+        for(char c : {Chars...})
+            table[(unsigned char)c] = true;
+        return table;
+    }
+
+    // Lexer for a separator set fixed at compile time, for example StaticLexer<' ', '\n', ','>
+    // The set becomes a constexpr lookup table so no separator list is walked while lexing
+    // It gives the same tokens as lex / lex_view with the same separators as a string
+    template<char... Separators>
+    class StaticLexer
+    {
+        public:
+        static constexpr bool is_separator(char c) { return _table[(unsigned char)c]; }
+
+        // Calls onToken(token, isSeparator) for every non empty token and, if includeSeparators, every separator
+        template<typename OnToken>
+        static void for_each(std::string_view data, bool includeSeparators, OnToken onToken);
+
+        static std::vector<std::string_view> lex_view(std::string_view data, bool includeSeparators = false);
+        static std::vector<std::string> lex(std::string_view data, bool includeSeparators = false);
+
+        private:
+        static constexpr std::array<bool, 256> _table = make_char_table<Separators...>();
     };
 
     // To check is a string ends with another string
@@ -81,6 +280,610 @@ namespace lexpp{
     // Docs comming soon ...
     std::vector<Token> lex(std::shared_ptr<TokenParser> parser);
 
+    // Same as lex(std::shared_ptr<TokenParser>) but the functions of Parser are called directly instead of through
+    // virtual calls so they can be inlined. Parser has to be the most derived type of the object. It can also be
+    // any class with the same functions as TokenParser without deriving from it.
+    template<typename Parser, typename = decltype(&Parser::process_token)>
+    std::vector<Token> lex(Parser& parser);
+
+    // The versions below allocate the result and all the token text from resource instead of the global allocator
+    // With a std::pmr::monotonic_buffer_resource everything a call allocated is freed at once by releasing it
+    // Tokens are TokenViews pointing into memory from resource and location is the offset in the data
+
+    // Only the vector is allocated from resource, the views point into data so data must outlive them
+    std::pmr::vector<std::string_view> lex_view(std::string_view data, std::string_view separators, bool includeSeparators, std::pmr::memory_resource* resource);
+
+    // Same as above with separators of any length
+    std::pmr::vector<std::string_view> lex_view(std::string_view data, const std::vector<std::string>& separators, bool includeSeparators, std::pmr::memory_resource* resource);
+
+    // The vector and the text of every token (the pmr::strings too long for their inline buffer) come from resource
+    std::pmr::vector<std::pmr::string> lex(std::string_view data, std::string_view separators, bool includeSeparators, std::pmr::memory_resource* resource);
+
+    // Same as above with separators of any length
+    std::pmr::vector<std::pmr::string> lex(std::string_view data, const std::vector<std::string>& separators, bool includeSeparators, std::pmr::memory_resource* resource);
+
+    // Same as lex with a tokenFunction. The vector and a copy of the text of every token, as tokenFunction left it,
+    // come from resource so the TokenViews live as long as resource does, not data
+    std::pmr::vector<TokenView> lex(std::string_view data, const std::vector<std::string>& separators, std::function<int(std::string&, bool*, bool, Token*)> tokenFunction, bool includeSeparators, std::pmr::memory_resource* resource);
+
+    // Same as lex(std::shared_ptr<TokenParser>), the vector and the token text are allocated from resource as above
+    std::pmr::vector<TokenView> lex(std::shared_ptr<TokenParser> parser, std::pmr::memory_resource* resource);
+
+    // Same as lex(Parser&) with the functions of Parser called directly, allocating from resource as above
+    template<typename Parser, typename = decltype(&Parser::process_token)>
+    std::pmr::vector<TokenView> lex(Parser& parser, std::pmr::memory_resource* resource);
+
+    // Copies text into memory from resource
+    std::string_view copy_to_resource(std::string_view text, std::pmr::memory_resource* resource);
+
+    // Zero-copy versions of lex, the returned views point into data so data must outlive them
+    std::vector<std::string_view> lex_view(std::string_view data, std::string_view separators, bool includeSeparators = false);
+
+    // Same as above with separators of any length, the longest separator at a position wins
+    std::vector<std::string_view> lex_view(std::string_view data, const std::vector<std::string>& separators, bool includeSeparators = false);
+
+    // tokenFunction gets every token as a view into data with its location filled in, it returns the type,
+    // can set the userdata of the TokenView or discard the token. The values still point into data
+    std::vector<TokenView> lex_view(std::string_view data, const std::vector<std::string>& separators, std::function<int(std::string_view, bool*, bool, TokenView*)> tokenFunction, bool includeSeparators = false);
+
+    // Incremental lexer, the input is given in chunks to feed and finish flushes the last token
+    // Tokens and separators split across chunks are carried over, so only the unfinished token is kept
+    // in memory. The views given to tokenFunction are only valid during the call.
+    class StreamLexer
+    {
+        public:
+        typedef std::function<void(std::string_view token, bool isSeparator, size_t location)> TokenFunction;
+
+        StreamLexer(std::string_view separators, TokenFunction tokenFunction, bool includeSeparators = false);
+        StreamLexer(const std::vector<std::string>& separators, TokenFunction tokenFunction, bool includeSeparators = false);
+
+        void feed(std::string_view chunk);
+        void finish();
+        // Total number of bytes given to feed since the last finish
+        size_t bytes_fed() const { return _location + _pending.size(); }
+
+        private:
+        size_t lex_buffer(std::string_view data, bool final);
+
+        SeparatorTrie _trie;
+        TokenFunction _tokenFunction;
+        bool _includeSeparators;
+        // The unfinished token (and maybe the start of a separator) from the previous chunks
+        std::string _pending;
+        // How much of _pending is already known to hold no separator
+        size_t _scanned;
+        // Location of _pending in the whole input
+        size_t _location;
+    };
+
+    // Lazy range over the tokens of data, each token is found only when the iterator reaches it
+    // Gives the same tokens as lex_view and works with range-for and C++20 ranges. The range must outlive its iterators.
+    class TokenRange
+    {
+        public:
+        class iterator
+        {
+            public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef std::string_view value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const std::string_view* pointer;
+            typedef const std::string_view& reference;
+
+            iterator();
+
+            reference operator*() const { return _token; }
+            pointer operator->() const { return &_token; }
+            iterator& operator++();
+            iterator operator++(int);
+            bool operator==(const iterator& other) const;
+            bool operator!=(const iterator& other) const { return !(*this == other); }
+
+            bool is_separator() const { return _isSeparator; }
+            // Byte offset of the current token in data
+            size_t location() const;
+
+            private:
+            friend class TokenRange;
+            iterator(const TokenRange* range);
+            void advance();
+
+            const TokenRange* _range;
+            std::string_view _token;
+            bool _isSeparator;
+            // Where scanning continues
+            size_t _position;
+            // Start of the token being built
+            size_t _start;
+            // Length of a separator found right after the current token and not given out yet
+            size_t _pendingSeparator;
+        };
+
+        TokenRange(std::string_view data, std::string_view separators, bool includeSeparators = false);
+        TokenRange(std::string_view data, const std::vector<std::string>& separators, bool includeSeparators = false);
+
+        iterator begin() const { return iterator(this); }
+        iterator end() const { return iterator(); }
+
+        private:
+        std::string_view _data;
+        SeparatorTrie _trie;
+        bool _includeSeparators;
+    };
+
+    // Tokens stored as separate columns (struct of arrays) instead of an array of Token
+    // A token is only its type, offset and length in data, userdata is kept only once some token has it
+    // Offset is the type of the offsets and lengths, uint32_t for inputs up to 4 GB, use LargeTokenBuffer (uint64_t)
+    // for bigger ones. push_back asserts that they fit. Types are stored as int32_t like the type of TokenView
+    template<typename Offset>
+    class BasicTokenBuffer
+    {
+        public:
+        BasicTokenBuffer() {}
+        BasicTokenBuffer(std::string_view data) : _data(data) {}
+
+        void push_back(size_t offset, size_t length, int type, void* userdata = nullptr);
+        void reserve(size_t count);
+        void clear();
+
+        size_t size() const { return _types.size(); }
+        bool empty() const { return _types.empty(); }
+
+        // The buffer the offsets point into
+        std::string_view data() const { return _data; }
+        void set_data(std::string_view data) { _data = data; }
+
+        std::string_view value(size_t index) const { return _data.substr(_offsets[index], _lengths[index]); }
+        int type(size_t index) const { return _types[index]; }
+        size_t offset(size_t index) const { return _offsets[index]; }
+        size_t length(size_t index) const { return _lengths[index]; }
+        void* userdata(size_t index) const { return _userdata.empty() ? nullptr : _userdata[index]; }
+        TokenView operator[](size_t index) const { return {value(index), type(index), userdata(index), offset(index)}; }
+
+        // The columns, contiguous so passes over a single one stay cache friendly
+        const std::vector<int32_t>& types() const { return _types; }
+        const std::vector<Offset>& offsets() const { return _offsets; }
+        const std::vector<Offset>& lengths() const { return _lengths; }
+        // Empty if no token has userdata
+        const std::vector<void*>& userdata() const { return _userdata; }
+
+        private:
+        std::string_view _data;
+        std::vector<int32_t> _types;
+        std::vector<Offset> _offsets;
+        std::vector<Offset> _lengths;
+        std::vector<void*> _userdata;
+    };
+
+    typedef BasicTokenBuffer<uint32_t> TokenBuffer;
+    typedef BasicTokenBuffer<uint64_t> LargeTokenBuffer;
+
+    // Same tokens as lex_view stored in a TokenBuffer, the type is 1 for separators and 0 for other tokens
+    template<typename Buffer = TokenBuffer>
+    Buffer lex_buffer(std::string_view data, std::string_view separators, bool includeSeparators = false);
+
+    // Same as above with separators of any length, the offsets point into data so data must outlive the buffer
+    template<typename Buffer = TokenBuffer>
+    Buffer lex_buffer(std::string_view data, const std::vector<std::string>& separators, bool includeSeparators = false);
+
+    // Same as lex(Parser&) but stores the tokens in a TokenBuffer. The data of the buffer is the data of the parser
+    // which has to stay alive as long as it, and the tokens point to their original text even if process_token changed it
+    template<typename Buffer = TokenBuffer, typename Parser, typename = decltype(&Parser::process_token)>
+    Buffer lex_buffer(Parser& parser);
+
+    struct LinePosition
+    {
+        size_t line;
+        size_t column;
+    };
+
+    // Offsets where every line of data starts, found with the SIMD separator scan
+    // Turns a byte offset (like Token::location) into a line and column in O(log n), both zero based
+    class LineIndex
+    {
+        public:
+        // An empty index has the single line of empty data
+        LineIndex() : _lineStarts(1, 0) {}
+        LineIndex(std::string_view data);
+        void build(std::string_view data);
+
+        size_t line_count() const { return _lineStarts.size(); }
+        size_t line_start(size_t line) const { return _lineStarts[line]; }
+        size_t line(size_t offset) const;
+        LinePosition position(size_t offset) const;
+
+        private:
+        std::vector<size_t> _lineStarts;
+    };
+
+    // Separators and options compiled once and then used for any number of inputs
+    // Lexing never changes a Lexer so one can be shared by many threads
+    class Lexer
+    {
+        public:
+        // Every char of separators is a separator
+        Lexer(std::string_view separators, bool includeSeparators = false);
+        Lexer(const std::vector<std::string>& separators, bool includeSeparators = false);
+
+        std::vector<std::string> lex(std::string_view data) const;
+        std::vector<std::string_view> lex_view(std::string_view data) const;
+        // Clears tokens and fills it again so its memory is reused across calls
+        void lex_view(std::string_view data, std::vector<std::string_view>& tokens) const;
+        // Uses a vector owned by the calling thread, the result is valid until the next call on the same thread
+        const std::vector<std::string_view>& lex_scratch(std::string_view data) const;
+
+        // Calls onToken(token, isSeparator) for every token, it can be inlined
+        template<typename OnToken>
+        void for_each(std::string_view data, OnToken&& onToken) const;
+
+        const SeparatorTrie& trie() const { return _trie; }
+        bool include_separators() const { return _includeSeparators; }
+
+        private:
+        SeparatorTrie _trie;
+        bool _includeSeparators;
+    };
+
+    // Template implementations
+
+    // Bytes a stored token holds on the heap, only small strings fit inside the object
+    template<typename T>
+    size_t token_heap_bytes(const T& token)
+    {
+        if constexpr(std::is_same<T, Token>::value)
+            return token_heap_bytes(token.value);
+        else if constexpr(std::is_same<T, std::string>::value || std::is_same<T, std::pmr::string>::value)
+            return token.capacity() > T().capacity() ? token.capacity() + 1 : 0;
+        else
+            return 0;
+    }
+
+    // emplace_back that counts the allocations it made in the current stats
+    template<typename Container, typename... Args>
+    void emplace_token(Container& tokens, Args&&... args)
+    {
+#ifdef LEXPP_STATS
+        size_t capacity = tokens.capacity();
+        tokens.emplace_back(std::forward<Args>(args)...);
+        LexStats* stats = current_lex_stats();
+        if(stats == nullptr)
+            return;
+        if(tokens.capacity() != capacity){
+            stats->allocations++;
+            stats->bytesAllocated += tokens.capacity() * sizeof(typename Container::value_type);
+        }
+        if(size_t bytes = token_heap_bytes(tokens.back())){
+            stats->allocations++;
+            stats->bytesAllocated += bytes;
+        }
+#else
+        tokens.emplace_back(std::forward<Args>(args)...);
+#endif
+    }
+
+    template<typename Accept>
+    size_t SeparatorTrie::match(const char* data, size_t size, Accept accept) const
+    {
+        size_t length = match(data, size);
+        // Shorter candidates are only needed if a longer one gets rejected
+        while(length > 0 && !accept(length))
+            length = match(data, length - 1);
+        return length;
+    }
+
+    // Walks data once and calls onToken(location, size, isSeparator) for every non empty token and every separator
+    // accept(location, size) can reject a separator candidate. Returns the location of the trailing token.
+    template<typename Accept, typename OnToken>
+    size_t scan_separators(std::string_view data, const SeparatorTrie& trie, Accept accept, OnToken onToken)
+    {
+        LEXPP_STAT(bytesScanned, data.size());
+        const CharClass& firstBytes = trie.first_bytes();
+        const char* end = data.data() + data.size();
+        // Start of the current token
+        size_t start = 0;
+        size_t i = 0;
+        while(i < data.size()){
+            // Jump to the next byte that can start a separator
+            i = firstBytes.find(data.data() + i, end) - data.data();
+            if(i == data.size())
+                break;
+            LEXPP_STAT(separatorMatches, 1);
+            size_t length = trie.match(data.data() + i, data.size() - i, [&](size_t size){
+                bool accepted = accept(i, size);
+                if(!accepted)
+                    LEXPP_STAT(separatorRejections, 1);
+                return accepted;
+            });
+            if(length == 0){
+                i++;
+                continue;
+            }
+            if(i > start)
+                onToken(start, i - start, false);
+            onToken(i, length, true);
+            i += length;
+            start = i;
+        }
+        return start;
+    }
+
+    template<char... Separators>
+    template<typename OnToken>
+    void StaticLexer<Separators...>::for_each(std::string_view data, bool includeSeparators, OnToken onToken)
+    {
+        LEXPP_STAT_TIMER(lexSeconds);
+        LEXPP_STAT(bytesScanned, data.size());
+        const char* p = data.data();
+        const char* end = p + data.size();
+        // Start of the current token
+        const char* start = p;
+        for( ; p != end ; p++){
+            if(_table[(unsigned char)*p]){
+                LEXPP_STAT(separatorMatches, 1);
+                // Only push token if its length > 0
+                if(p > start){
+                    LEXPP_STAT(tokensEmitted, 1);
+                    onToken(std::string_view(start, p - start), false);
+                }
+                if(includeSeparators){
+                    LEXPP_STAT(tokensEmitted, 1);
+                    onToken(std::string_view(p, 1), true);
+                }
+                start = p + 1;
+            }
+        }
+        if(end > start){
+            LEXPP_STAT(tokensEmitted, 1);
+            onToken(std::string_view(start, end - start), false);
+        }
+    }
+
+    template<char... Separators>
+    std::vector<std::string_view> StaticLexer<Separators...>::lex_view(std::string_view data, bool includeSeparators)
+    {
+        std::vector<std::string_view> tokens;
+        for_each(data, includeSeparators, [&tokens](std::string_view token, bool){ emplace_token(tokens, token); });
+        return tokens;
+    }
+
+    template<char... Separators>
+    std::vector<std::string> StaticLexer<Separators...>::lex(std::string_view data, bool includeSeparators)
+    {
+        std::vector<std::string> tokens;
+        for_each(data, includeSeparators, [&tokens](std::string_view token, bool){ emplace_token(tokens, token); });
+        return tokens;
+    }
+
+    // Lexes data and calls process(token, discard, isSeparator, tok) for every token, the ones that are not
+    // discarded are given to store(tok, token, location, size) with the place of the token in data.
+    // The last token is always processed even if it is empty
+    template<typename Process, typename Accept, typename Store>
+    void lex_tokens(std::string_view data, const SeparatorTrie& trie, bool includeSeparators, Process&& process, Accept&& accept, Store&& store)
+    {
+        LEXPP_STAT_TIMER(lexSeconds);
+        // Store individual tokens
+        std::string token;
+        auto emit = [&](size_t location, size_t size, bool isSeparator){
+            token.assign(data.data() + location, size);
+            Token tok;
+            tok.userdata = nullptr;
+            tok.location = (int)location;
+            bool discard = false;
+            {
+                LEXPP_STAT_TIMER(processSeconds);
+                tok.type = process(token, &discard, isSeparator, &tok);
+            }
+            if(discard){
+                LEXPP_STAT(tokensDiscarded, 1);
+                return;
+            }
+            LEXPP_STAT(tokensEmitted, 1);
+            store(tok, token, location, size);
+        };
+        size_t start = scan_separators(data, trie, accept, [&](size_t location, size_t size, bool isSeparator){
+            if(!isSeparator || includeSeparators)
+                emit(location, size, isSeparator);
+        });
+        emit(start, data.size() - start, false);
+    }
+
+    // True if Parser does not override TokenParser::get_data so its data can be used in place
+    template<typename Parser>
+    constexpr bool has_default_get_data()
+    {
+        return std::is_same<decltype(&Parser::get_data), std::string (TokenParser::*)()>::value;
+    }
+
+    // Runs lex_tokens over data with the functions of Parser called directly, see lex(Parser&)
+    template<typename Parser, typename Store>
+    void lex_direct(Parser& parser, std::string_view data, Store&& store)
+    {
+        auto process = [&parser](std::string& token, bool* discard, bool isSeparator, Token* tok){
+            return parser.Parser::process_token(token, discard, isSeparator, tok);
+        };
+        auto accept = [&](size_t location, size_t size){
+            // No need to build the separator string if accept_separator is the default one
+            if constexpr(std::is_same<decltype(&Parser::accept_separator), bool (TokenParser::*)(int, std::string)>::value)
+                return true;
+            else
+                return parser.Parser::accept_separator((int)location, std::string(data.substr(location, size)));
+        };
+#ifdef LEXPP_STATS
+        LexStatsScope statsScope(parser.Parser::stats() ? parser.Parser::stats() : current_lex_stats());
+#endif
+        SeparatorTrie trie;
+        {
+            LEXPP_STAT_TIMER(setupSeconds);
+            trie = SeparatorTrie(parser.Parser::get_separators());
+        }
+        lex_tokens(data, trie, parser.Parser::include_separators(), process, accept, store);
+        parser.Parser::on_end();
+    }
+
+    // Runs lex_tokens with the virtual functions of parser
+    template<typename Store>
+    void lex_virtual(const std::shared_ptr<TokenParser>& parser, Store&& store)
+    {
+        std::string data = parser->get_data();
+        auto process = [&parser](std::string& token, bool* discard, bool isSeparator, Token* tok){
+            return parser->process_token(token, discard, isSeparator, tok);
+        };
+        auto accept = [&](size_t location, size_t size){
+            return parser->accept_separator((int)location, data.substr(location, size));
+        };
+#ifdef LEXPP_STATS
+        LexStatsScope statsScope(parser->stats() ? parser->stats() : current_lex_stats());
+#endif
+        SeparatorTrie trie;
+        {
+            LEXPP_STAT_TIMER(setupSeconds);
+            trie = SeparatorTrie(parser->get_separators());
+        }
+        lex_tokens(data, trie, parser->include_separators(), process, accept, store);
+        parser->on_end();
+    }
+
+    template<typename Parser, typename Store>
+    void lex_direct(Parser& parser, Store&& store)
+    {
+        // Without an override of get_data the data of the parser is lexed in place instead of copied
+        if constexpr(has_default_get_data<Parser>())
+            lex_direct(parser, parser.data(), store);
+        else
+            lex_direct(parser, parser.Parser::get_data(), store);
+    }
+
+    template<typename Parser, typename>
+    std::vector<Token> lex(Parser& parser)
+    {
+        // The tokens for return
+        std::vector<Token> tokens;
+        lex_direct(parser, [&tokens](Token& tok, std::string& token, size_t, size_t){
+            tok.value = token;
+            emplace_token(tokens, std::move(tok));
+        });
+        return tokens;
+    }
+
+    template<typename Parser, typename>
+    std::pmr::vector<TokenView> lex(Parser& parser, std::pmr::memory_resource* resource)
+    {
+        // The tokens for return
+        std::pmr::vector<TokenView> tokens(resource);
+        lex_direct(parser, [&](Token& tok, std::string& token, size_t location, size_t){
+            emplace_token(tokens, TokenView{copy_to_resource(token, resource), tok.type, tok.userdata, location});
+        });
+        return tokens;
+    }
+
+    template<typename Buffer, typename Parser, typename>
+    Buffer lex_buffer(Parser& parser)
+    {
+        static_assert(has_default_get_data<Parser>(), "The tokens point into the data of the parser so Parser can not override get_data");
+        Buffer buffer(parser.data());
+        lex_direct(parser, [&buffer](Token& tok, std::string&, size_t location, size_t size){
+            buffer.push_back(location, size, tok.type, tok.userdata);
+        });
+        return buffer;
+    }
+
+    template<typename Offset>
+    void BasicTokenBuffer<Offset>::push_back(size_t offset, size_t length, int type, void* userdata)
+    {
+#ifdef LEXPP_STATS
+        size_t capacity = _types.capacity();
+#endif
+        // A TokenBuffer only holds inputs up to 4 GB, see LargeTokenBuffer
+        assert(offset <= std::numeric_limits<Offset>::max() && length <= std::numeric_limits<Offset>::max());
+        _types.push_back((int32_t)type);
+        _offsets.push_back((Offset)offset);
+        _lengths.push_back((Offset)length);
+#ifdef LEXPP_STATS
+        // The columns grow together
+        if(_types.capacity() != capacity){
+            LEXPP_STAT(allocations, 3);
+            LEXPP_STAT(bytesAllocated, _types.capacity() * (sizeof(int32_t) + 2 * sizeof(Offset)));
+        }
+#endif
+        if(userdata != nullptr && _userdata.empty())
+            _userdata.resize(_types.size() - 1, nullptr);
+        if(!_userdata.empty())
+            _userdata.push_back(userdata);
+    }
+
+    template<typename Offset>
+    void BasicTokenBuffer<Offset>::reserve(size_t count)
+    {
+        _types.reserve(count);
+        _offsets.reserve(count);
+        _lengths.reserve(count);
+        if(!_userdata.empty())
+            _userdata.reserve(count);
+    }
+
+    template<typename Offset>
+    void BasicTokenBuffer<Offset>::clear()
+    {
+        _types.clear();
+        _offsets.clear();
+        _lengths.clear();
+        _userdata.clear();
+    }
+
+    template<typename Buffer>
+    Buffer lex_buffer(std::string_view data, std::string_view separators, bool includeSeparators)
+    {
+        Buffer buffer(data);
+        TokenRange range(data, separators, includeSeparators);
+        for(TokenRange::iterator it = range.begin() ; it != range.end() ; ++it)
+            buffer.push_back(it.location(), it->size(), it.is_separator() ? 1 : 0);
+        return buffer;
+    }
+
+    template<typename Buffer>
+    Buffer lex_buffer(std::string_view data, const std::vector<std::string>& separators, bool includeSeparators)
+    {
+        Buffer buffer(data);
+        TokenRange range(data, separators, includeSeparators);
+        for(TokenRange::iterator it = range.begin() ; it != range.end() ; ++it)
+            buffer.push_back(it.location(), it->size(), it.is_separator() ? 1 : 0);
+        return buffer;
+    }
+
+    template<typename OnToken>
+    void Lexer::for_each(std::string_view data, OnToken&& onToken) const
+    {
+        LEXPP_STAT_TIMER(lexSeconds);
+        auto emit = [&onToken](std::string_view token, bool isSeparator){
+            LEXPP_STAT(tokensEmitted, 1);
+            onToken(token, isSeparator);
+        };
+        const char* end = data.data() + data.size();
+        // Start of the current token
+        const char* start = data.data();
+        if(_trie.max_length() <= 1){
+            LEXPP_STAT(bytesScanned, data.size());
+            // Only single byte separators so the first byte set is the whole separator set
+            const CharClass& separators = _trie.first_bytes();
+            for(const char* p = separators.find(start, end) ; p != end ; p = separators.find(p + 1, end)){
+                LEXPP_STAT(separatorMatches, 1);
+                if(p > start)
+                    emit(std::string_view(start, p - start), false);
+                if(_includeSeparators)
+                    emit(std::string_view(p, 1), true);
+                start = p + 1;
+            }
+        }
+        else{
+            start += scan_separators(data, _trie, [](size_t, size_t){ return true; }, [&](size_t location, size_t size, bool isSeparator){
+                if(!isSeparator || _includeSeparators)
+                    emit(data.substr(location, size), isSeparator);
+            });
+        }
+        if(end > start)
+            emit(std::string_view(start, end - start), false);
+    }
+
 #ifdef LEXPP_IMPLEMENTATION
 
 // Functions implementations
@@ -93,212 +896,697 @@ namespace lexpp{
 
     std::vector<std::string> lex(std::string data, std::string separators, bool includeSeparators)
     {
-        // Store individual tokens
-        std::string token;
         // The tokens for return
         std::vector<std::string> tokens;
-        for(int i = 0 ; i < data.size() ; i++){
-            // If the character is a separator then push the token before it to tokens list
-            if(separators.find(data[i]) != std::string::npos){
-                // Only push token if its length > 0
-                if(token.size() > 0)
-                    tokens.push_back(token);
-                if(includeSeparators)
-                    tokens.push_back(std::string(1, data[i]));
-                token = "";
-            }
-            else{
-                token += data[i];
-            }
-        }
-        if(token.size() > 0)
-            tokens.push_back(token);
+        for(std::string_view token : lex_view(data, separators, includeSeparators))
+            emplace_token(tokens, token);
         return tokens;
     }
 
     std::vector<std::string> lex(std::string data, std::vector<std::string> separators, bool includeSeparators)
     {
-        // Store individual tokens
-        std::string token;
         // The tokens for return
         std::vector<std::string> tokens;
-        for(int i = 0 ; i < data.size() ; i++){
-            // If the token string ends with a separator then push the token before it to tokens list
-
-            std::string sep = "";
-            for(std::string& separator : separators){
-                if(ends_with(token, separator)){
-                    sep = separator;
-                    break;
-                }
-            }
-            if(sep != ""){
-                // Only push token if its length > 0
-                token = token.substr(0, token.size() - sep.size());
-                if(token.size() > 0)
-                    tokens.push_back(token);
-                if(includeSeparators)
-                    tokens.push_back(sep);
-                token = "";
-            }
-            token += data[i];
-        }
-        if(token.size() > 0)
-            tokens.push_back(token);
+        for(std::string_view token : lex_view(data, separators, includeSeparators))
+            emplace_token(tokens, token);
         return tokens;
     }
 
     std::vector<Token> lex(std::string data, std::vector<std::string> separators, std::function<int(std::string&, bool*, bool)> tokenFunction, bool includeSeparators)
     {
-           // Store individual tokens
-        std::string token;
+        return lex(data, separators, [&tokenFunction](std::string& token, bool* discard, bool isSeparator, Token*) -> int {
+            return tokenFunction(token, discard, isSeparator);
+        }, includeSeparators);
+    }
+
+    std::vector<Token> lex(std::string data, std::vector<std::string> separators, std::function<int(std::string&, bool*, bool, Token*)> tokenFunction, bool includeSeparators)
+    {
         // The tokens for return
         std::vector<Token> tokens;
-        for(int i = 0 ; i < data.size() ; i++){
-            // If the token string ends with a separator then push the token before it to tokens list
-
-            std::string sep = "";
-            for(std::string& separator : separators){
-                if(ends_with(token, separator)){
-                    sep = separator;
-                    break;
-                }
-            }
-            if(sep != ""){
-                // Only push token if its length > 0
-                token = token.substr(0, token.size() - sep.size());
-                if(token.size() > 0){
-                    Token tok;
-                    bool discard = false;
-                    tok.type = tokenFunction(token, &discard, false);
-                    tok.value = token;
-                    if(!discard)
-                        tokens.push_back(tok);
-                }
-                if(includeSeparators){
-                    Token tok;
-                    bool discard = false;
-                    tok.type = tokenFunction(sep, &discard, true);
-                    tok.value = sep;
-                    if(!discard)
-                        tokens.push_back(tok);
-                }
-                token = "";
-            }
-            token += data[i];
-        }
-        Token tok;
-        bool discard = false;
-        tok.type = tokenFunction(token, &discard, false);
-        tok.value = token;
-        if(!discard)
-            tokens.push_back(tok);
+        lex_tokens(data, SeparatorTrie(separators), includeSeparators, tokenFunction, [](size_t, size_t){ return true; }, [&tokens](Token& tok, std::string& token, size_t, size_t){
+            tok.value = token;
+            emplace_token(tokens, std::move(tok));
+        });
         return tokens;
     }
 
-    std::vector<Token> lex(std::string data, std::vector<std::string> separators, std::function<int(std::string&, bool*, bool, Token*)> tokenFunction, bool includeSeparators)
-     {
-           // Store individual tokens
-        std::string token;
+    std::vector<Token> lex(std::shared_ptr<TokenParser> parser)
+    {
         // The tokens for return
         std::vector<Token> tokens;
-        for(int i = 0 ; i < data.size() ; i++){
-            // If the token string ends with a separator then push the token before it to tokens list
-
-            std::string sep = "";
-            for(std::string& separator : separators){
-                if(ends_with(token, separator)){
-                    sep = separator;
-                    break;
-                }
-            }
-            if(sep != ""){
-                // Only push token if its length > 0
-                token = token.substr(0, token.size() - sep.size());
-                if(token.size() > 0){
-                    Token tok;
-                    bool discard = false;
-                    tok.type = tokenFunction(token, &discard, false, &tok);
-                    tok.value = token;
-                    if(!discard)
-                        tokens.push_back(tok);
-                }
-                if(includeSeparators){
-                    Token tok;
-                    bool discard = false;
-                    tok.type = tokenFunction(sep, &discard, true, &tok);
-                    tok.value = sep;
-                    if(!discard)
-                        tokens.push_back(tok);
-                }
-                token = "";
-            }
-            token += data[i];
+        lex_virtual(parser, [&tokens](Token& tok, std::string& token, size_t, size_t){
+            tok.value = token;
+            emplace_token(tokens, std::move(tok));
+        });
+        return tokens;
+    }
+
+    std::string_view copy_to_resource(std::string_view text, std::pmr::memory_resource* resource)
+    {
+        if(text.size() == 0)
+            return std::string_view();
+        LEXPP_STAT(allocations, 1);
+        LEXPP_STAT(bytesAllocated, text.size());
+        char* copy = (char*)resource->allocate(text.size(), 1);
+        std::copy(text.begin(), text.end(), copy);
+        return std::string_view(copy, text.size());
+    }
+
+    std::pmr::vector<std::string_view> lex_view(std::string_view data, std::string_view separators, bool includeSeparators, std::pmr::memory_resource* resource)
+    {
+        std::pmr::vector<std::string_view> tokens(resource);
+        for(std::string_view token : TokenRange(data, separators, includeSeparators))
+            emplace_token(tokens, token);
+        return tokens;
+    }
+
+    std::pmr::vector<std::string_view> lex_view(std::string_view data, const std::vector<std::string>& separators, bool includeSeparators, std::pmr::memory_resource* resource)
+    {
+        std::pmr::vector<std::string_view> tokens(resource);
+        for(std::string_view token : TokenRange(data, separators, includeSeparators))
+            emplace_token(tokens, token);
+        return tokens;
+    }
+
+    std::pmr::vector<std::pmr::string> lex(std::string_view data, std::string_view separators, bool includeSeparators, std::pmr::memory_resource* resource)
+    {
+        // The allocator of the vector is passed on to the strings it holds
+        std::pmr::vector<std::pmr::string> tokens(resource);
+        for(std::string_view token : TokenRange(data, separators, includeSeparators))
+            emplace_token(tokens, token);
+        return tokens;
+    }
+
+    std::pmr::vector<std::pmr::string> lex(std::string_view data, const std::vector<std::string>& separators, bool includeSeparators, std::pmr::memory_resource* resource)
+    {
+        std::pmr::vector<std::pmr::string> tokens(resource);
+        for(std::string_view token : TokenRange(data, separators, includeSeparators))
+            emplace_token(tokens, token);
+        return tokens;
+    }
+
+    std::pmr::vector<TokenView> lex(std::string_view data, const std::vector<std::string>& separators, std::function<int(std::string&, bool*, bool, Token*)> tokenFunction, bool includeSeparators, std::pmr::memory_resource* resource)
+    {
+        std::pmr::vector<TokenView> tokens(resource);
+        lex_tokens(data, SeparatorTrie(separators), includeSeparators, tokenFunction, [](size_t, size_t){ return true; }, [&](Token& tok, std::string& token, size_t location, size_t){
+            emplace_token(tokens, TokenView{copy_to_resource(token, resource), tok.type, tok.userdata, location});
+        });
+        return tokens;
+    }
+
+    std::pmr::vector<TokenView> lex(std::shared_ptr<TokenParser> parser, std::pmr::memory_resource* resource)
+    {
+        std::pmr::vector<TokenView> tokens(resource);
+        lex_virtual(parser, [&](Token& tok, std::string& token, size_t location, size_t){
+            emplace_token(tokens, TokenView{copy_to_resource(token, resource), tok.type, tok.userdata, location});
+        });
+        return tokens;
+    }
+
+    std::vector<std::string_view> lex_view(std::string_view data, std::string_view separators, bool includeSeparators)
+    {
+        LEXPP_STAT_TIMER(lexSeconds);
+        LEXPP_STAT(bytesScanned, data.size());
+        CharClass separatorClass(separators);
+        const char* end = data.data() + data.size();
+        // Start of the current token
+        const char* start = data.data();
+        // The tokens for return
+        std::vector<std::string_view> tokens;
+        for(const char* p = separatorClass.find(start, end) ; p != end ; p = separatorClass.find(p + 1, end)){
+            LEXPP_STAT(separatorMatches, 1);
+            // Only push token if its length > 0
+            if(p > start)
+                emplace_token(tokens, start, p - start);
+            if(includeSeparators)
+                emplace_token(tokens, p, 1);
+            start = p + 1;
         }
-        Token tok;
-        bool discard = false;
-        tok.type = tokenFunction(token, &discard, false, &tok);
-        tok.value = token;
-        if(!discard)
-            tokens.push_back(tok);
+        if(end > start)
+            emplace_token(tokens, start, end - start);
+        LEXPP_STAT(tokensEmitted, tokens.size());
         return tokens;
     }
 
-    std::vector<Token> lex(std::shared_ptr<TokenParser> parser)
+    std::vector<std::string_view> lex_view(std::string_view data, const std::vector<std::string>& separators, bool includeSeparators)
     {
-        std::string data = parser->get_data();
-        std::vector<std::string> separators = parser->get_separators();
-        bool includeSeparators = parser->include_separators();
-        // Store individual tokens
-        std::string token;
+        SeparatorTrie trie;
+        {
+            LEXPP_STAT_TIMER(setupSeconds);
+            trie = SeparatorTrie(separators);
+        }
+        LEXPP_STAT_TIMER(lexSeconds);
         // The tokens for return
-        std::vector<Token> tokens;
-        for(int i = 0 ; i < data.size() ; i++){
-            // If the token string ends with a separator then push the token before it to tokens list
-
-            std::string sep = "";
-            for(std::string& separator : separators){
-                if(ends_with(token, separator)){
-                    if(parser->accept_separator(i - separator.size(), separator))
-                    {
-                        sep = separator;
-                        break;
-                    }
-                }
+        std::vector<std::string_view> tokens;
+        size_t start = scan_separators(data, trie, [](size_t, size_t){ return true; }, [&](size_t location, size_t size, bool isSeparator){
+            if(!isSeparator || includeSeparators)
+                emplace_token(tokens, data.substr(location, size));
+        });
+        if(data.size() > start)
+            emplace_token(tokens, data.substr(start));
+        LEXPP_STAT(tokensEmitted, tokens.size());
+        return tokens;
+    }
+
+    std::vector<TokenView> lex_view(std::string_view data, const std::vector<std::string>& separators, std::function<int(std::string_view, bool*, bool, TokenView*)> tokenFunction, bool includeSeparators)
+    {
+        SeparatorTrie trie;
+        {
+            LEXPP_STAT_TIMER(setupSeconds);
+            trie = SeparatorTrie(separators);
+        }
+        LEXPP_STAT_TIMER(lexSeconds);
+        // The tokens for return
+        std::vector<TokenView> tokens;
+        auto emit = [&](size_t location, size_t size, bool isSeparator){
+            TokenView tok;
+            tok.value = data.substr(location, size);
+            tok.userdata = nullptr;
+            tok.location = location;
+            bool discard = false;
+            {
+                LEXPP_STAT_TIMER(processSeconds);
+                tok.type = tokenFunction(tok.value, &discard, isSeparator, &tok);
             }
-            if(sep != ""){
-                // Only push token if its length > 0
-                token = token.substr(0, token.size() - sep.size());
-                if(token.size() > 0){
-                    Token tok;
-                    bool discard = false;
-                    tok.type = parser->process_token(token, &discard, false, &tok);
-                    tok.value = token;
-                    if(!discard)
-                        tokens.push_back(tok);
+            if(discard){
+                LEXPP_STAT(tokensDiscarded, 1);
+                return;
+            }
+            LEXPP_STAT(tokensEmitted, 1);
+            emplace_token(tokens, tok);
+        };
+        size_t start = scan_separators(data, trie, [](size_t, size_t){ return true; }, [&](size_t location, size_t size, bool isSeparator){
+            if(!isSeparator || includeSeparators)
+                emit(location, size, isSeparator);
+        });
+        if(data.size() > start)
+            emit(start, data.size() - start, false);
+        return tokens;
+    }
+
+    // Class Function Implementations
+
+    // CharClass
+
+    static const char* find_scalar(const char* begin, const char* end, const CharClass& charClass)
+    {
+        for( ; begin != end ; begin++){
+            if(charClass.contains(*begin))
+                return begin;
+        }
+        return end;
+    }
+
+#ifdef LEXPP_X86_SIMD
+
+    static inline int count_trailing_zeros(uint32_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, value);
+        return (int)index;
+#else
+        return __builtin_ctz(value);
+#endif
+    }
+
+    // The kernels classify 16 or 32 bytes at once with two nibble table lookups (pshufb)
+    // and then confirm every candidate against the exact bitmap
+    struct CharClassKernels
+    {
+        LEXPP_TARGET("ssse3")
+        static const char* find_ssse3(const char* begin, const char* end, const CharClass& charClass)
+        {
+            const __m128i low = _mm_load_si128((const __m128i*)charClass._lowNibble);
+            const __m128i high = _mm_load_si128((const __m128i*)charClass._highNibble);
+            const __m128i nibble = _mm_set1_epi8(0x0f);
+            const __m128i zero = _mm_setzero_si128();
+            for( ; end - begin >= 16 ; begin += 16){
+                __m128i v = _mm_loadu_si128((const __m128i*)begin);
+                __m128i l = _mm_shuffle_epi8(low, _mm_and_si128(v, nibble));
+                __m128i h = _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+                uint32_t mask = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(l, h), zero)) & 0xffff;
+                for( ; mask != 0 ; mask &= mask - 1){
+                    const char* p = begin + count_trailing_zeros(mask);
+                    if(charClass.contains(*p))
+                        return p;
                 }
-                if(includeSeparators){
-                    Token tok;
-                    bool discard = false;
-                    tok.type = parser->process_token(sep, &discard, true, &tok);
-                    tok.value = sep;
-                    if(!discard)
-                        tokens.push_back(tok);
+            }
+            return find_scalar(begin, end, charClass);
+        }
+
+        LEXPP_TARGET("avx2")
+        static const char* find_avx2(const char* begin, const char* end, const CharClass& charClass)
+        {
+            const __m256i low = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)charClass._lowNibble));
+            const __m256i high = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)charClass._highNibble));
+            const __m256i nibble = _mm256_set1_epi8(0x0f);
+            const __m256i zero = _mm256_setzero_si256();
+            for( ; end - begin >= 32 ; begin += 32){
+                __m256i v = _mm256_loadu_si256((const __m256i*)begin);
+                __m256i l = _mm256_shuffle_epi8(low, _mm256_and_si256(v, nibble));
+                __m256i h = _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+                uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(l, h), zero));
+                for( ; mask != 0 ; mask &= mask - 1){
+                    const char* p = begin + count_trailing_zeros(mask);
+                    if(charClass.contains(*p))
+                        return p;
                 }
-                token = "";
             }
-            token += data[i];
+            return find_ssse3(begin, end, charClass);
         }
-        Token tok;
-        bool discard = false;
-        tok.type = parser->process_token(token, &discard, false, &tok);
-        tok.value = token;
-        if(!discard)
-            tokens.push_back(tok);
+    };
+
+    typedef const char* (*CharClassFindFunction)(const char*, const char*, const CharClass&);
+
+    static CharClassFindFunction select_find_function()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        int maxLeaf = info[0];
+        __cpuid(info, 1);
+        bool ssse3 = (info[2] & (1 << 9)) != 0;
+        bool osAvx = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+        bool avx2 = false;
+        if(maxLeaf >= 7 && osAvx){
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0;
+        }
+#else
+        __builtin_cpu_init();
+        bool ssse3 = __builtin_cpu_supports("ssse3");
+        bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+        if(avx2)
+            return CharClassKernels::find_avx2;
+        if(ssse3)
+            return CharClassKernels::find_ssse3;
+        return find_scalar;
+    }
+
+#endif
+
+    CharClass::CharClass()
+    {
+        std::fill(_bits, _bits + 4, 0);
+        build_nibble_tables();
+    }
+
+    CharClass::CharClass(std::string_view chars)
+    :CharClass()
+    {
+        for(char c : chars)
+            _bits[(unsigned char)c >> 6] |= (uint64_t)1 << ((unsigned char)c & 63);
+        build_nibble_tables();
+    }
+
+    void CharClass::add(char c)
+    {
+        _bits[(unsigned char)c >> 6] |= (uint64_t)1 << ((unsigned char)c & 63);
+        build_nibble_tables();
+    }
+
+    void CharClass::build_nibble_tables()
+    {
+        std::fill(_lowNibble, _lowNibble + 16, 0);
+        std::fill(_highNibble, _highNibble + 16, 0);
+        // Every high nibble that has a distinct set of low nibbles gets its own bucket,
+        // past 8 buckets they get shared which only adds candidates the bitmap rejects
+        uint16_t bucketLows[8];
+        int buckets = 0;
+        for(int high = 0 ; high < 16 ; high++){
+            // The 16 bytes with this high nibble are 16 consecutive bits of the map
+            uint16_t lows = (uint16_t)(_bits[high >> 2] >> ((high & 3) * 16));
+            if(lows == 0)
+                continue;
+            int bucket = 0;
+            while(bucket < buckets && bucketLows[bucket] != lows)
+                bucket++;
+            if(bucket == buckets){
+                if(buckets < 8)
+                    bucketLows[buckets++] = lows;
+                else
+                    bucket = high % 8;
+            }
+            _highNibble[high] |= 1 << bucket;
+            for(int low = 0 ; low < 16 ; low++){
+                if(lows & (1 << low))
+                    _lowNibble[low] |= 1 << bucket;
+            }
+        }
+    }
+
+    const char* CharClass::find(const char* begin, const char* end) const
+    {
+#ifdef LEXPP_X86_SIMD
+        static const CharClassFindFunction findFunction = select_find_function();
+        return findFunction(begin, end, *this);
+#else
+        return find_scalar(begin, end, *this);
+#endif
+    }
+
+    // SeparatorTrie
+
+    SeparatorTrie::SeparatorTrie()
+    :_maxLength(0)
+    {
+        std::fill(_root, _root + 256, -1);
+    }
+
+    SeparatorTrie::SeparatorTrie(const std::vector<std::string>& separators)
+    :SeparatorTrie()
+    {
+        for(const std::string& separator : separators)
+            insert(separator);
+    }
+
+    void SeparatorTrie::insert(std::string_view separator)
+    {
+        if(separator.size() == 0)
+            return;
+        int node = _root[(unsigned char)separator[0]];
+        if(node < 0){
+            node = _root[(unsigned char)separator[0]] = (int)_nodes.size();
+            _nodes.emplace_back();
+        }
+        for(size_t i = 1 ; i < separator.size() ; i++){
+            int next = child(node, separator[i]);
+            if(next < 0){
+                next = (int)_nodes.size();
+                _nodes[node].children.emplace_back(separator[i], next);
+                _nodes.emplace_back();
+            }
+            node = next;
+        }
+        _nodes[node].terminal = true;
+        _firstBytes.add(separator[0]);
+        _maxLength = std::max(_maxLength, separator.size());
+    }
+
+    int SeparatorTrie::child(int node, char c) const
+    {
+        for(const std::pair<char, int>& edge : _nodes[node].children){
+            if(edge.first == c)
+                return edge.second;
+        }
+        return -1;
+    }
+
+    size_t SeparatorTrie::match(const char* data, size_t size) const
+    {
+        if(size == 0)
+            return 0;
+        size_t longest = 0;
+        int node = _root[(unsigned char)data[0]];
+        for(size_t i = 1 ; node >= 0 ; i++){
+            if(_nodes[node].terminal)
+                longest = i;
+            if(i == size)
+                break;
+            node = child(node, data[i]);
+        }
+        return longest;
+    }
+
+    // StreamLexer
+
+    StreamLexer::StreamLexer(std::string_view separators, TokenFunction tokenFunction, bool includeSeparators)
+    :_tokenFunction(tokenFunction), _includeSeparators(includeSeparators), _scanned(0), _location(0)
+    {
+        for(char separator : separators)
+            _trie.insert(std::string_view(&separator, 1));
+    }
+
+    StreamLexer::StreamLexer(const std::vector<std::string>& separators, TokenFunction tokenFunction, bool includeSeparators)
+    :_trie(separators), _tokenFunction(tokenFunction), _includeSeparators(includeSeparators), _scanned(0), _location(0)
+    {}
+
+    void StreamLexer::feed(std::string_view chunk)
+    {
+        LEXPP_STAT(bytesScanned, chunk.size());
+        if(_pending.empty()){
+            // Nothing carried over so the chunk is lexed in place and only its tail is copied
+            size_t start = lex_buffer(chunk, false);
+            _pending.assign(chunk.data() + start, chunk.size() - start);
+            _location += start;
+        }
+        else{
+            _pending.append(chunk.data(), chunk.size());
+            size_t start = lex_buffer(_pending, false);
+            _pending.erase(0, start);
+            _location += start;
+        }
+    }
+
+    void StreamLexer::finish()
+    {
+        size_t start = lex_buffer(_pending, true);
+        if(_pending.size() > start){
+            LEXPP_STAT(tokensEmitted, 1);
+            _tokenFunction(std::string_view(_pending).substr(start), false, _location + start);
+        }
+        _pending.clear();
+        _scanned = 0;
+        _location = 0;
+    }
+
+    size_t StreamLexer::lex_buffer(std::string_view data, bool final)
+    {
+        LEXPP_STAT_TIMER(lexSeconds);
+        // A separator starting in the last max_length - 1 bytes may continue in the next chunk
+        size_t keep = (final || _trie.empty()) ? 0 : _trie.max_length() - 1;
+        size_t limit = data.size() > keep ? data.size() - keep : 0;
+        const char* end = data.data() + limit;
+        // Start of the current token
+        size_t start = 0;
+        size_t i = _scanned;
+        while(i < limit){
+            i = _trie.first_bytes().find(data.data() + i, end) - data.data();
+            if(i >= limit)
+                break;
+            LEXPP_STAT(separatorMatches, 1);
+            size_t length = _trie.match(data.data() + i, data.size() - i);
+            if(length == 0){
+                i++;
+                continue;
+            }
+            if(i > start){
+                LEXPP_STAT(tokensEmitted, 1);
+                _tokenFunction(data.substr(start, i - start), false, _location + start);
+            }
+            if(_includeSeparators){
+                LEXPP_STAT(tokensEmitted, 1);
+                _tokenFunction(data.substr(i, length), true, _location + i);
+            }
+            i += length;
+            start = i;
+        }
+        _scanned = std::max(i, limit) - start;
+        return start;
+    }
+
+    // TokenRange
+
+    TokenRange::TokenRange(std::string_view data, std::string_view separators, bool includeSeparators)
+    :_data(data), _includeSeparators(includeSeparators)
+    {
+        for(char separator : separators)
+            _trie.insert(std::string_view(&separator, 1));
+    }
+
+    TokenRange::TokenRange(std::string_view data, const std::vector<std::string>& separators, bool includeSeparators)
+    :_data(data), _trie(separators), _includeSeparators(includeSeparators)
+    {}
+
+    TokenRange::iterator::iterator()
+    :_range(nullptr), _isSeparator(false), _position(0), _start(0), _pendingSeparator(0)
+    {}
+
+    TokenRange::iterator::iterator(const TokenRange* range)
+    :_range(range), _isSeparator(false), _position(0), _start(0), _pendingSeparator(0)
+    {
+        LEXPP_STAT(bytesScanned, range->_data.size());
+        advance();
+    }
+
+    TokenRange::iterator& TokenRange::iterator::operator++()
+    {
+        advance();
+        return *this;
+    }
+
+    TokenRange::iterator TokenRange::iterator::operator++(int)
+    {
+        iterator copy = *this;
+        advance();
+        return copy;
+    }
+
+    bool TokenRange::iterator::operator==(const iterator& other) const
+    {
+        if(_range == nullptr || other._range == nullptr)
+            return _range == other._range;
+        return _range == other._range && _token.data() == other._token.data() && _isSeparator == other._isSeparator;
+    }
+
+    size_t TokenRange::iterator::location() const
+    {
+        return _token.data() - _range->_data.data();
+    }
+
+    void TokenRange::iterator::advance()
+    {
+        std::string_view data = _range->_data;
+        const SeparatorTrie& trie = _range->_trie;
+        if(_pendingSeparator > 0){
+            LEXPP_STAT(tokensEmitted, 1);
+            _token = data.substr(_position - _pendingSeparator, _pendingSeparator);
+            _isSeparator = true;
+            _pendingSeparator = 0;
+            return;
+        }
+        const char* end = data.data() + data.size();
+        while(_position < data.size()){
+            size_t i = trie.first_bytes().find(data.data() + _position, end) - data.data();
+            if(i == data.size())
+                break;
+            LEXPP_STAT(separatorMatches, 1);
+            size_t length = trie.match(data.data() + i, data.size() - i);
+            if(length == 0){
+                _position = i + 1;
+                continue;
+            }
+            size_t start = _start;
+            _position = _start = i + length;
+            if(i > start){
+                _token = data.substr(start, i - start);
+                _isSeparator = false;
+                if(_range->_includeSeparators)
+                    _pendingSeparator = length;
+                LEXPP_STAT(tokensEmitted, 1);
+                return;
+            }
+            if(_range->_includeSeparators){
+                _token = data.substr(i, length);
+                _isSeparator = true;
+                LEXPP_STAT(tokensEmitted, 1);
+                return;
+            }
+        }
+        if(data.size() > _start){
+            LEXPP_STAT(tokensEmitted, 1);
+            _token = data.substr(_start);
+            _isSeparator = false;
+            _position = _start = data.size();
+            return;
+        }
+        // Nothing left so this becomes the end iterator
+        *this = iterator();
+    }
+
+    // LineIndex
+
+    LineIndex::LineIndex(std::string_view data)
+    {
+        build(data);
+    }
+
+    void LineIndex::build(std::string_view data)
+    {
+        static const CharClass newline("\n");
+        const char* end = data.data() + data.size();
+        _lineStarts.assign(1, 0);
+        for(const char* p = newline.find(data.data(), end) ; p != end ; p = newline.find(p + 1, end))
+            _lineStarts.push_back(p + 1 - data.data());
+    }
+
+    size_t LineIndex::line(size_t offset) const
+    {
+        return std::upper_bound(_lineStarts.begin(), _lineStarts.end(), offset) - _lineStarts.begin() - 1;
+    }
+
+    LinePosition LineIndex::position(size_t offset) const
+    {
+        size_t index = line(offset);
+        return {index, offset - _lineStarts[index]};
+    }
+
+    // Lexer
+
+    Lexer::Lexer(std::string_view separators, bool includeSeparators)
+    :_includeSeparators(includeSeparators)
+    {
+        for(char separator : separators)
+            _trie.insert(std::string_view(&separator, 1));
+    }
+
+    Lexer::Lexer(const std::vector<std::string>& separators, bool includeSeparators)
+    :_trie(separators), _includeSeparators(includeSeparators)
+    {}
+
+    std::vector<std::string> Lexer::lex(std::string_view data) const
+    {
+        std::vector<std::string> tokens;
+        for_each(data, [&tokens](std::string_view token, bool){ emplace_token(tokens, token); });
         return tokens;
     }
 
-    // Class Function Implementations
+    std::vector<std::string_view> Lexer::lex_view(std::string_view data) const
+    {
+        std::vector<std::string_view> tokens;
+        lex_view(data, tokens);
+        return tokens;
+    }
+
+    void Lexer::lex_view(std::string_view data, std::vector<std::string_view>& tokens) const
+    {
+        tokens.clear();
+        for_each(data, [&tokens](std::string_view token, bool){ emplace_token(tokens, token); });
+    }
+
+    const std::vector<std::string_view>& Lexer::lex_scratch(std::string_view data) const
+    {
+        static thread_local std::vector<std::string_view> tokens;
+        lex_view(data, tokens);
+        return tokens;
+    }
+
+    // LexStats
+
+    static thread_local LexStats* currentLexStats = nullptr;
+
+    LexStats* current_lex_stats()
+    {
+        return currentLexStats;
+    }
+
+    LexStatsScope::LexStatsScope(LexStats* stats)
+    :_previous(currentLexStats)
+    {
+        currentLexStats = stats;
+    }
+
+    LexStatsScope::~LexStatsScope()
+    {
+        currentLexStats = _previous;
+    }
+
+    LexStats& LexStats::operator+=(const LexStats& other)
+    {
+        bytesScanned += other.bytesScanned;
+        tokensEmitted += other.tokensEmitted;
+        tokensDiscarded += other.tokensDiscarded;
+        separatorMatches += other.separatorMatches;
+        separatorRejections += other.separatorRejections;
+        allocations += other.allocations;
+        bytesAllocated += other.bytesAllocated;
+        setupSeconds += other.setupSeconds;
+        lexSeconds += other.lexSeconds;
+        processSeconds += other.processSeconds;
+        return *this;
+    }
 
     // TokenParser
 